@@ -291,14 +291,36 @@ inline static bool SET_PGD(uintptr_t _pgd) {
     return true;
 }
 
+/**
+ * @brief 设置页目录与 PCID
+ * @param  _pgd            要设置的页表
+ * @param  _pcid           PCID，需要已经开启 CR4.PCIDE
+ * @param  _flush          是否刷新 _pcid 的页表缓存
+ */
+inline static void SET_PGD(uintptr_t _pgd, size_t _pcid, bool _flush) {
+#if defined(__x86_64__)
+    uintptr_t cr3 = _pgd | _pcid;
+    // 第 63 位为 1 时不刷新
+    if (_flush == false) {
+        cr3 |= (uintptr_t)1 << 63;
+    }
+    __asm__ volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+#else
+    (void)_pcid;
+    (void)_flush;
+    SET_PGD(_pgd);
+#endif
+    return;
+}
+
 /**
  * @brief 获取页目录 CR3
- * @return uintptr_t        CR3 值
+ * @return uintptr_t        CR3 值，不包括 PCID 等低 12 位
  */
 inline static uintptr_t GET_PGD(void) {
     uintptr_t cr3;
     __asm__ volatile("mov %%cr3, %0" : "=b"(cr3));
-    return cr3;
+    return cr3 & ~(uintptr_t)0xFFF;
 }
 
 /**
@@ -313,23 +335,60 @@ inline static void switch_stack(void* _stack_top) {
 
 /**
  * @brief 读取 CR4
- * @return uint32_t        CR4 值
+ * @return uintptr_t        CR4 值
  */
-inline static uint32_t READ_CR4(void) {
-    uint32_t cr4;
-    __asm__ volatile("mov %%cr4, %0" : "=b"(cr4));
+inline static uintptr_t READ_CR4(void) {
+    uintptr_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
     return cr4;
 }
 
+/**
+ * @brief 写 CR4
+ * @param  _cr4             要写入的值
+ */
+inline static void WRITE_CR4(uintptr_t _cr4) {
+    __asm__ volatile("mov %0, %%cr4" : : "r"(_cr4));
+    return;
+}
+
 /**
  * @brief 刷新页表缓存
- * @param  _addr            要刷新的地址
+ * @param  _addr            要刷新的地址，包括全局页
  */
 inline static void VMM_FLUSH(uintptr_t _addr) {
     __asm__ volatile("invlpg (%0)" : : "r"(_addr) : "memory");
     return;
 }
 
+/**
+ * @brief 刷新地址空间的页表缓存，全局页不受影响
+ * @note 重新加载 CR3，只能刷新当前的地址空间(PCID)
+ */
+inline static void VMM_FLUSH_ASID(size_t) {
+    uintptr_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    return;
+}
+
+/**
+ * @brief 刷新全部页表缓存，包括全局页
+ * @note 开启了 PGE 时，切换 PGE 会刷新全部(包括所有 PCID)，
+ *       否则重新加载 CR3，此时 VMM::init_asid 不会开启 PCIDE
+ */
+inline static void VMM_FLUSH_ALL(void) {
+    uintptr_t cr4 = READ_CR4();
+    if ((cr4 & CR4_PGE) != 0) {
+        WRITE_CR4(cr4 & ~(uintptr_t)CR4_PGE);
+        WRITE_CR4(cr4);
+    }
+    else {
+        VMM_FLUSH_ASID(0);
+    }
+    return;
+}
+
 // 开启 PG
 inline static bool ENABLE_PG(void) {
     uintptr_t cr0 = 0;
@@ -386,6 +445,27 @@ inline static void WRITE_MSR(uint32_t _idx, uint64_t _msr) {
     return;
 }
 
+/**
+ * @brief 读时间戳计数器
+ * @return uint64_t         读到的值
+ */
+inline static uint64_t READ_TIME(void) {
+    uint32_t low;
+    uint32_t high;
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 获取当前 core id
+ * @return size_t           core id
+ * @todo 目前只启动了 BSP，多核启动后从 gs 指向的 per-cpu 数据中读取
+ * CPUID 在虚拟机中会陷入，不适合在频繁调用的路径上使用
+ */
+inline static size_t GET_CORE_ID(void) {
+    return 0;
+}
+
 /// @todo 改为 static
 class CPUID {
 private:
@@ -473,6 +553,9 @@ private:
     static constexpr const uint32_t FEAT_EDX_IA64       = 1 << 30;
     static constexpr const uint32_t FEAT_EDX_PBE        = 1 << 31;
 
+    // INTEL_FEATURES 的 edx
+    static constexpr const uint32_t EXT_FEAT_EDX_PAGE1GB = 1 << 26;
+
     enum : uint32_t {
         GET_VENDOR = 0x00,
         GET_FEATURES,
@@ -542,6 +625,53 @@ public:
         return ecx & FEAT_ECX_x2APIC;
     }
 
+    /**
+     * @brief 是否支持 4MB 页(32 位分页)
+     * @return true            支持
+     * @return false           不支持
+     */
+    bool pse(void) {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(GET_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+        return edx & FEAT_EDX_PSE;
+    }
+
+    /**
+     * @brief 是否支持 PCID
+     * @return true            支持
+     * @return false           不支持
+     */
+    bool pcid(void) {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(GET_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+        return ecx & FEAT_ECX_PCIDE;
+    }
+
+    /**
+     * @brief 是否支持全局页
+     * @return true            支持
+     * @return false           不支持
+     */
+    bool pge(void) {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(GET_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+        return edx & FEAT_EDX_PGE;
+    }
+
+    /**
+     * @brief 是否支持 1GB 页(4 级分页)
+     * @return true            支持
+     * @return false           不支持
+     */
+    bool page1gb(void) {
+        if (max_cpuidex < INTEL_FEATURES) {
+            return false;
+        }
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(INTEL_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+        return edx & EXT_FEAT_EDX_PAGE1GB;
+    }
+
     bool eoi(void) {
         uint64_t version = READ_MSR(IA32_X2APIC_VERSION);
         return version & IA32_X2APIC_SIVR_EOI_ENABLE_BIT;
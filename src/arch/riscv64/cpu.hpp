@@ -455,6 +455,44 @@ inline static void SET_PGD(uintptr_t _x) {
     return;
 }
 
+/**
+ * @brief 设置页目录与 ASID
+ * @param  _x               要设置的页目录
+ * @param  _asid            ASID
+ * @param  _flush           是否刷新 _asid 的 tlb
+ */
+inline static void SET_PGD(uintptr_t _x, size_t _asid, bool _flush) {
+    satp_t satp;
+    asm("csrr %0, satp" : "=r"(satp));
+    satp.ppn  = _x >> satp_t::PPN_OFFSET;
+    satp.asid = _asid;
+    asm volatile("csrw satp, %0" : : "r"(satp) : "memory");
+    if (_flush == true) {
+        asm volatile("sfence.vma zero, %0" : : "r"(_asid) : "memory");
+    }
+    return;
+}
+
+/**
+ * @brief 获取实现的 ASID 位数
+ * @return size_t           位数，0 表示不支持 ASID
+ * @note ASID 字段是 WARL 的，写入全 1 后读回
+ * @note 开启分页后探测时，探测期间可能以该 ASID 缓存 tlb，恢复后刷新
+ */
+inline static size_t GET_ASID_BITS(void) {
+    satp_t old;
+    satp_t tmp;
+    asm("csrr %0, satp" : "=r"(old));
+    tmp      = old;
+    tmp.asid = 0xFFFF;
+    asm volatile("csrw satp, %0" : : "r"(tmp) : "memory");
+    asm volatile("csrr %0, satp" : "=r"(tmp));
+    asm volatile("csrw satp, %0" : : "r"(old) : "memory");
+    size_t asid = tmp.asid;
+    asm volatile("sfence.vma zero, %0" : : "r"(asid) : "memory");
+    return __builtin_popcount(asid);
+}
+
 /**
  * @brief 获取页目录，仅获取 ppn
  * @return uintptr_t        页目录
@@ -471,10 +509,9 @@ inline static uintptr_t GET_PGD(void) {
  * @return false            失败
  */
 inline static bool ENABLE_PG(void) {
-    uintptr_t x = GET_PGD();
-    satp_t    satp;
-    satp.ppn  = x >> satp_t::PPN_OFFSET;
-    satp.asid = 0;
+    satp_t satp;
+    // 保留已经设置的 ppn 与 asid
+    asm("csrr %0, satp" : "=r"(satp));
     satp.mode = satp_t::SV39;
     asm("csrw satp, %0" : : "r"(satp));
     info("paging enabled.\n");
@@ -610,6 +647,15 @@ inline static void WRITE_TP(uint64_t _x) {
     return;
 }
 
+/**
+ * @brief 获取当前 core id
+ * @return size_t           逻辑 CPU 编号，小于 COMMON::CPU_MAX
+ * @note 启动时 tp 被设置为逻辑编号，启动核为 0，与 hartid 无关
+ */
+inline static size_t GET_CORE_ID(void) {
+    return READ_TP();
+}
+
 /**
  * @brief 读 ra 寄存器
  * @return uint64_t         读到的值
@@ -621,11 +667,29 @@ inline static uint64_t READ_RA(void) {
 }
 
 /**
- * @brief 刷新 tlb
+ * @brief 刷新 tlb 中的一个地址
+ * @param  _addr            要刷新的地址，所有 ASID，包括全局页
+ */
+inline static void VMM_FLUSH(uintptr_t _addr) {
+    asm volatile("sfence.vma %0, zero" : : "r"(_addr) : "memory");
+    return;
+}
+
+/**
+ * @brief 刷新 tlb 中一个地址空间的所有地址，全局页不受影响
+ * @param  _asid            要刷新的 ASID
+ */
+inline static void VMM_FLUSH_ASID(size_t _asid) {
+    asm volatile("sfence.vma zero, %0" : : "r"(_asid) : "memory");
+    return;
+}
+
+/**
+ * @brief 刷新全部 tlb
  */
-inline static void VMM_FLUSH(uintptr_t) {
+inline static void VMM_FLUSH_ALL(void) {
     // the zero, zero means flush all TLB entries.
-    asm("sfence.vma zero, zero");
+    asm volatile("sfence.vma zero, zero" : : : "memory");
     return;
 }
 
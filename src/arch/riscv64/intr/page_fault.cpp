@@ -14,50 +14,41 @@
  * </table>
  */
 
+#include "cassert"
 #include "cpu.hpp"
 #include "cstdint"
 #include "cstdio"
-#include "pmm.h"
+#include "mm.h"
 #include "vmm.h"
 
 int32_t pg_load_excp(int, char**) {
     uintptr_t addr = CPU::READ_STVAL();
-    uintptr_t pa   = 0x0;
-    auto      is_mmap
-      = VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(), addr, &pa);
-    // 如果 is_mmap 为 true，说明已经应映射过了
-    if (is_mmap == true) {
-        // 直接映射
-        VMM::get_instance().mmap(VMM::get_instance().get_pgd(), addr, pa,
-                                 VMM_PAGE_READABLE);
+    // 直接映射区在启动时已经全部映射，不应该出现缺页
+    if (VMM_IS_DIRECT(addr) == true) {
+        err("pg_load_excp: 0x%p in direct map.\n", addr);
+        assert(0);
     }
-    else {
-        // 分配一页物理内存进行映射
-        pa = PMM::get_instance().alloc_page_kernel();
-        VMM::get_instance().mmap(VMM::get_instance().get_pgd(), addr, pa,
-                                 VMM_PAGE_READABLE);
+    // 由当前地址空间的区域决定如何映射，相邻的页会被一起映射
+    mm_t* mm = mm_t::get_current();
+    if ((mm == nullptr) || (mm->fault(addr, false) == false)) {
+        err("pg_load_excp: 0x%p not in any vma.\n", addr);
+        assert(0);
     }
-    info("pg_load_excp done: 0x%p.\n", addr);
     return 0;
 }
 
 int32_t pg_store_excp(int, char**) {
     uintptr_t addr = CPU::READ_STVAL();
-    uintptr_t pa   = 0x0;
-    auto      is_mmap
-      = VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(), addr, &pa);
-    // 如果 is_mmap 为 true，说明已经应映射过了
-    if (is_mmap == true) {
-        // 直接映射
-        VMM::get_instance().mmap(VMM::get_instance().get_pgd(), addr, pa,
-                                 VMM_PAGE_READABLE | VMM_PAGE_WRITABLE);
+    // 直接映射区在启动时已经全部映射，不应该出现缺页
+    if (VMM_IS_DIRECT(addr) == true) {
+        err("pg_store_excp: 0x%p in direct map.\n", addr);
+        assert(0);
     }
-    else {
-        // 分配一页物理内存进行映射
-        pa = PMM::get_instance().alloc_page_kernel();
-        VMM::get_instance().mmap(VMM::get_instance().get_pgd(), addr, pa,
-                                 VMM_PAGE_READABLE | VMM_PAGE_WRITABLE);
+    // 由当前地址空间的区域决定如何映射，相邻的页会被一起映射
+    mm_t* mm = mm_t::get_current();
+    if ((mm == nullptr) || (mm->fault(addr, true) == false)) {
+        err("pg_store_excp: 0x%p not in any vma or not writable.\n", addr);
+        assert(0);
     }
-    info("pg_store_excp done: 0x%p.\n", addr);
     return 0;
 }
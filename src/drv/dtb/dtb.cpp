@@ -150,10 +150,8 @@ void DTB::fill_resource(resource_t* _resource, const node_t* _node,
         }
         else if (_node->parent->address_cells == 2) {
             assert(_node->parent->size_cells == 2);
-            _resource->mem.addr = be32toh(((uint32_t*)_prop->addr)[0])
-                                + be32toh(((uint32_t*)_prop->addr)[1]);
-            _resource->mem.len = be32toh(((uint32_t*)_prop->addr)[2])
-                               + be32toh(((uint32_t*)_prop->addr)[3]);
+            _resource->mem.addr = read_cells((uint32_t*)_prop->addr, 2);
+            _resource->mem.len  = read_cells((uint32_t*)_prop->addr + 2, 2);
         }
         else {
             assert(0);
@@ -178,13 +176,60 @@ DTB::node_t* DTB::find_node_via_path(const char* _path) {
     return res;
 }
 
-void DTB::dtb_mem_reserved(void) {
+size_t DTB::dtb_mem_reserved(resource_t* _resources, size_t _max) {
+    size_t               count = 0;
     fdt_reserve_entry_t* entry = dtb_info.reserved;
-    if (entry->addr_le || entry->size_le) {
-        // 目前没有考虑这种情况，先报错
-        assert(0);
+    // 以地址与长度均为 0 的项结束
+    while ((entry->addr_be != 0) || (entry->addr_le != 0)
+           || (entry->size_be != 0) || (entry->size_le != 0)) {
+        if (count == _max) {
+            warn("too many reserved regions.\n");
+            break;
+        }
+        _resources[count].type     = resource_t::MEM;
+        _resources[count].name     = (char*)"fdt reserved";
+        _resources[count].mem.addr = read_cells(&entry->addr_be, 2);
+        _resources[count].mem.len  = read_cells(&entry->size_be, 2);
+        count++;
+        entry++;
     }
-    return;
+    return count;
+}
+
+uint64_t DTB::read_cells(const uint32_t* _addr, uint32_t _cells) {
+    uint64_t ret = 0;
+    // 高位在前
+    for (uint32_t i = 0; i < _cells; i++) {
+        ret = (ret << 32) | be32toh(_addr[i]);
+    }
+    return ret;
+}
+
+size_t DTB::add_reg(const node_t* _node, resource_t* _resources,
+                    size_t _count, size_t _max) {
+    uint32_t addr_cells = _node->parent->address_cells;
+    uint32_t size_cells = _node->parent->size_cells;
+    for (size_t i = 0; i < _node->prop_count; i++) {
+        if (strcmp(_node->props[i].name, "reg") != 0) {
+            continue;
+        }
+        uint32_t* reg   = (uint32_t*)_node->props[i].addr;
+        // 每一项的 cell 数
+        size_t    cells = addr_cells + size_cells;
+        for (size_t j = 0; j + cells <= _node->props[i].len / 4; j += cells) {
+            if (_count == _max) {
+                warn("too many memory regions.\n");
+                return _count;
+            }
+            _resources[_count].type     = resource_t::MEM;
+            _resources[_count].name     = _node->path.path[_node->path.len - 1];
+            _resources[_count].mem.addr = read_cells(reg + j, addr_cells);
+            _resources[_count].mem.len
+              = read_cells(reg + j + addr_cells, size_cells);
+            _count++;
+        }
+    }
+    return _count;
 }
 
 void DTB::dtb_iter(uint8_t _cb_flags, bool (*_cb)(const iter_data_t*, void*),
@@ -390,8 +435,6 @@ bool DTB::dtb_init(void) {
     // 字符区
     dtb_info.str
       = BOOT_INFO::boot_info_addr + be32toh(dtb_info.header->off_dt_strings);
-    // 检查保留内存
-    dtb_mem_reserved();
     // 初始化 map
     bzero(nodes, sizeof(nodes));
     bzero(phandle_map, sizeof(phandle_map));
@@ -471,6 +514,36 @@ size_t DTB::find_via_prefix(const char* _prefix, resource_t* _resource) {
     return res;
 }
 
+size_t DTB::get_memory_regions(resource_t* _resources, size_t _max,
+                               bool _reserved) {
+    size_t count = 0;
+    // fdt 头中的内存保留区
+    if (_reserved == true) {
+        count = dtb_mem_reserved(_resources, _max);
+    }
+    for (size_t i = 0; i < nodes[0].count; i++) {
+        // 跳过根节点
+        if (nodes[i].parent == nullptr) {
+            continue;
+        }
+        const char* name   = nodes[i].path.path[nodes[i].path.len - 1];
+        const char* parent = nodes[i].parent->path.path[nodes[i].path.len - 2];
+        // reserved-memory 的子节点
+        if (_reserved == true) {
+            if (strcmp(parent, "reserved-memory") == 0) {
+                count = add_reg(&nodes[i], _resources, count, _max);
+            }
+        }
+        // 根节点下的 memory 节点
+        else if ((nodes[i].parent->parent == nullptr)
+                 && ((strcmp(name, "memory") == 0)
+                     || (strncmp(name, "memory@", strlen("memory@")) == 0))) {
+            count = add_reg(&nodes[i], _resources, count, _max);
+        }
+    }
+    return count;
+}
+
 std::ostream& operator<<(std::ostream& _os, const DTB::iter_data_t& _iter) {
     // 输出路径
     _os << _iter.path << ": ";
@@ -614,6 +687,14 @@ size_t find_via_prefix(const char* _prefix, resource_t* _resource) {
     return DTB::get_instance().find_via_prefix(_prefix, _resource);
 }
 
+size_t get_memory_regions(resource_t* _resources, size_t _max) {
+    return DTB::get_instance().get_memory_regions(_resources, _max, false);
+}
+
+size_t get_reserved_regions(resource_t* _resources, size_t _max) {
+    return DTB::get_instance().get_memory_regions(_resources, _max, true);
+}
+
 resource_t get_clint(void) {
     resource_t resource;
     // 设置 resource 基本信息
@@ -301,9 +301,31 @@ private:
     static phandle_map_t phandle_map[MAX_NODES];
 
     /**
-     * @brief 输出 reserved 内存
+     * @brief 读取 reserved 内存，即 fdt 头中的内存保留区
+     * @param  _resources      结果数组
+     * @param  _max            数组长度
+     * @return size_t          区域数
      */
-    void                 dtb_mem_reserved(void);
+    size_t dtb_mem_reserved(resource_t* _resources, size_t _max);
+
+    /**
+     * @brief 读取 _cells 个 cell 组成的数值
+     * @param  _addr           数据地址
+     * @param  _cells          cell 数，1 或 2
+     * @return uint64_t        读到的值
+     */
+    static uint64_t read_cells(const uint32_t* _addr, uint32_t _cells);
+
+    /**
+     * @brief 将节点 reg 属性中的所有 (地址, 长度) 对加入 _resources
+     * @param  _node           节点
+     * @param  _resources      结果数组
+     * @param  _count          已有的区域数
+     * @param  _max            数组长度
+     * @return size_t          新的区域数
+     */
+    size_t add_reg(const node_t* _node, resource_t* _resources, size_t _count,
+                   size_t _max);
 
     /**
      * @brief 迭代函数
@@ -408,6 +430,18 @@ public:
      */
     size_t find_via_prefix(const char* _prefix, resource_t* _resource);
 
+    /**
+     * @brief 获取物理内存区域
+     * @param  _resources      结果数组
+     * @param  _max            数组长度
+     * @param  _reserved       true 返回 reserved-memory 与内存保留区，
+     * false 返回 memory 节点
+     * @return size_t          区域数
+     * @note 一个节点的 reg 中可能有多个区域
+     */
+    size_t get_memory_regions(resource_t* _resources, size_t _max,
+                              bool _reserved);
+
     /**
      * @brief iter 输出
      * @param  _os             输出流
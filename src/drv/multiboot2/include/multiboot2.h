@@ -303,6 +303,20 @@ private:
     };
 
 public:
+    /**
+     * @brief 查找内存区域时使用的数据
+     */
+    struct mem_regions_t {
+        /// 结果数组
+        resource_t* resources;
+        /// 数组长度
+        size_t      max;
+        /// 已找到的区域数
+        size_t      count;
+        /// true 查找保留区域，false 查找可用区域
+        bool        reserved;
+    };
+
     /**
      * @brief 获取单例
      * @return MULTIBOOT2&      静态对象
@@ -331,6 +345,16 @@ public:
      * @return false           失败
      */
     static bool get_memory(const iter_data_t* _iter_data, void* _data);
+
+    /**
+     * @brief 获取内存区域信息
+     * @param  _iter_data      迭代变量
+     * @param  _data           数据，mem_regions_t
+     * @return true            成功
+     * @return false           失败
+     * @note 超出地址空间的部分会被截断
+     */
+    static bool get_memory_regions(const iter_data_t* _iter_data, void* _data);
 };
 
 namespace BOOT_INFO {
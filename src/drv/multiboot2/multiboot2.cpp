@@ -90,6 +90,50 @@ bool MULTIBOOT2::get_memory(const iter_data_t* _iter_data, void* _data) {
     return true;
 }
 
+bool MULTIBOOT2::get_memory_regions(const iter_data_t* _iter_data,
+                                    void*              _data) {
+    if (_iter_data->type != MULTIBOOT2::MULTIBOOT_TAG_TYPE_MMAP) {
+        return false;
+    }
+    mem_regions_t* regions = (mem_regions_t*)_data;
+    // 地址空间上限，32 位下超过 4GB 的部分无法使用
+    uint64_t       limit   = UINTPTR_MAX & COMMON::PAGE_MASK;
+    MULTIBOOT2::multiboot_mmap_entry_t* mmap
+      = ((MULTIBOOT2::multiboot_tag_mmap_t*)_iter_data)->entries;
+    for (; (uint8_t*)mmap < (uint8_t*)_iter_data + _iter_data->size;
+         mmap
+         = (MULTIBOOT2::
+              multiboot_mmap_entry_t*)((uint8_t*)mmap
+                                       + ((MULTIBOOT2::multiboot_tag_mmap_t*)
+                                            _iter_data)
+                                           ->entry_size)) {
+        // 类型不符合
+        if ((mmap->type == MULTIBOOT_MEMORY_AVAILABLE) == regions->reserved) {
+            continue;
+        }
+        // 超出地址空间
+        if (mmap->addr >= limit) {
+            continue;
+        }
+        if (regions->count == regions->max) {
+            warn("too many memory regions.\n");
+            break;
+        }
+        uint64_t end = mmap->addr + mmap->len;
+        if (end > limit) {
+            end = limit;
+        }
+        resource_t* resource  = &regions->resources[regions->count];
+        resource->type       |= resource_t::MEM;
+        resource->name        = regions->reserved ? (char*)"reserved memory"
+                                                  : (char*)"available memory";
+        resource->mem.addr    = mmap->addr;
+        resource->mem.len     = end - mmap->addr;
+        regions->count++;
+    }
+    return true;
+}
+
 namespace BOOT_INFO {
 // 地址
 uintptr_t boot_info_addr;
@@ -118,4 +162,18 @@ resource_t get_memory(void) {
                                                &resource);
     return resource;
 }
+
+size_t get_memory_regions(resource_t* _resources, size_t _max) {
+    MULTIBOOT2::mem_regions_t regions = {_resources, _max, 0, false};
+    MULTIBOOT2::get_instance().multiboot2_iter(MULTIBOOT2::get_memory_regions,
+                                               &regions);
+    return regions.count;
+}
+
+size_t get_reserved_regions(resource_t* _resources, size_t _max) {
+    MULTIBOOT2::mem_regions_t regions = {_resources, _max, 0, true};
+    MULTIBOOT2::get_instance().multiboot2_iter(MULTIBOOT2::get_memory_regions,
+                                               &regions);
+    return regions.count;
+}
 };    // namespace BOOT_INFO
@@ -53,6 +53,23 @@ extern bool          init(void);
  */
 extern resource_t    get_memory(void);
 
+/**
+ * @brief 获取可用的物理内存区域
+ * @param  _resources      结果数组
+ * @param  _max            数组长度
+ * @return size_t          区域数
+ */
+extern size_t        get_memory_regions(resource_t* _resources, size_t _max);
+
+/**
+ * @brief 获取保留的物理内存区域
+ * @param  _resources      结果数组
+ * @param  _max            数组长度
+ * @return size_t          区域数
+ * @note 保留区域可能与可用区域重叠，重叠部分不能被分配
+ */
+extern size_t        get_reserved_regions(resource_t* _resources, size_t _max);
+
 /**
  * @brief 获取 clint 信息
  * @return resource_t       clint 资源信息
@@ -45,6 +45,8 @@ static constexpr const size_t   MB        = 0x100000;
 static constexpr const size_t   GB        = 0x40000000;
 /// 页大小 4KB
 static constexpr const size_t   PAGE_SIZE = 4 * KB;
+/// 页大小的位数，PAGE_SIZE == 1 << PAGE_SHIFT
+static constexpr const size_t   PAGE_SHIFT = 12;
 /// 内核空间占用大小，包括内核代码部分与预留的，8MB
 static constexpr const uint32_t KERNEL_SPACE_SIZE = 8 * MB;
 /// 映射内核空间需要的页数
@@ -52,6 +54,8 @@ static constexpr const uint64_t KERNEL_SPACE_PAGES
   = KERNEL_SPACE_SIZE / PAGE_SIZE;
 /// 栈大小
 static constexpr const uintptr_t STACK_SIZE = 4 * KB;
+/// 最大 CPU 数，每个 CPU 的数据按 GET_CORE_ID 返回的逻辑编号索引
+static constexpr const size_t    CPU_MAX    = 8;
 
 // 页掩码
 static constexpr const uintptr_t PAGE_MASK  = ~(PAGE_SIZE - 1);
@@ -0,0 +1,132 @@
+/**
+ * @file alloc_bench.h
+ * @brief 页分配器基准测试头文件
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_ALLOC_BENCH_H
+#define SIMPLEKERNEL_ALLOC_BENCH_H
+
+#include "allocator.h"
+#include "cstddef"
+#include "cstdint"
+
+/**
+ * @brief 页分配器基准测试
+ * 对 ALLOCATOR 进行随机的分配/释放，大小混合单页与多页，
+ * 统计每次操作的时间，并定期输出最长的连续空闲页数
+ * @note 不依赖内核的其它部分，也可以在宿主机上编译运行，见 tools/hostbench
+ */
+class ALLOC_BENCH {
+public:
+    /// 空闲块直方图的项数
+    static constexpr const size_t ORDERS = 20;
+
+    /**
+     * @brief 一次尚未释放的分配
+     */
+    struct live_t {
+        /// 地址
+        uintptr_t addr;
+        /// 页数
+        size_t    len;
+    };
+
+    /**
+     * @brief 测试结果
+     */
+    struct result_t {
+        /// 成功的分配次数
+        size_t   allocs;
+        /// 失败的分配次数
+        size_t   fails;
+        /// 释放次数
+        size_t   frees;
+        /// 每次分配的平均时间，单位为 ns
+        uint64_t alloc_ns;
+        /// 每次释放的平均时间，单位为 ns
+        uint64_t free_ns;
+        /// 运行过程中最长连续空闲页数的最小值
+        size_t   largest_min;
+        /// 结束时最长的连续空闲页数
+        size_t   largest;
+        /// 结束时的空闲块直方图
+        size_t   hist[ORDERS];
+    };
+
+private:
+    /// 名称
+    const char* name;
+    /// 被测试的分配器
+    ALLOCATOR*  allocator;
+    /// 尚未释放的分配
+    live_t*     live;
+    /// live 长度
+    size_t      live_max;
+    /// live 中的项数
+    size_t      live_count;
+    /// CPU::READ_TIME 每秒的计数
+    uint64_t    freq;
+    /// 随机数状态
+    uint64_t    state;
+
+    /**
+     * @brief xorshift 随机数
+     * @return uint64_t        随机数
+     */
+    uint64_t    rand(void);
+
+    /**
+     * @brief 随机的分配页数
+     * @return size_t          页数，一半为单页，其余最大 512 页
+     */
+    size_t      rand_len(void);
+
+    /**
+     * @brief 计算每次操作的平均时间
+     * @param  _ticks          总计数
+     * @param  _ops            操作次数
+     * @return uint64_t        平均时间，单位为 ns
+     */
+    uint64_t    to_ns(uint64_t _ticks, size_t _ops) const;
+
+public:
+    /**
+     * @brief 构造
+     * @param  _name           名称
+     * @param  _allocator      被测试的分配器，以页为单位
+     * @param  _live           保存尚未释放的分配，由调用者提供
+     * @param  _live_max       _live 长度，即同时存在的最大分配数
+     * @param  _freq           CPU::READ_TIME 每秒的计数
+     * @param  _seed           随机数种子，不能为 0
+     */
+    ALLOC_BENCH(const char* _name, ALLOCATOR* _allocator, live_t* _live,
+                size_t _live_max, uint64_t _freq, uint64_t _seed);
+
+    ~ALLOC_BENCH(void);
+
+    /**
+     * @brief 运行
+     * @param  _ops            操作次数
+     * @param  _interval       每 _interval 次操作输出一次碎片情况
+     * @return result_t        结果
+     * @note 结束时不会释放剩余的分配，需要调用 free_all
+     */
+    result_t run(size_t _ops, size_t _interval);
+
+    /**
+     * @brief 释放所有剩余的分配
+     */
+    void     free_all(void);
+};
+
+#endif /* SIMPLEKERNEL_ALLOC_BENCH_H */
@@ -65,6 +65,15 @@ public:
      */
     virtual bool      alloc(uintptr_t _addr, size_t _len) = 0;
 
+    /**
+     * @brief 分配起始地址按 _align 对齐的 _len 页
+     * @param  _len            页数
+     * @param  _align          对齐，单位为 bytes，需要为页大小的 2 的幂倍
+     * @return uintptr_t       分配到的地址，失败返回 0
+     * @note 默认实现多分配 _align 长度后归还首尾，只适用于以页为单位的分配器
+     */
+    virtual uintptr_t alloc_aligned(size_t _len, size_t _align);
+
     /**
      * @brief 释放 _len 长度
      * @param  _addr           地址
@@ -83,6 +92,16 @@ public:
      * @return size_t          数量
      */
     virtual size_t    get_free_count(void) const          = 0;
+
+    /**
+     * @brief 统计空闲块
+     * @param  _hist           _hist[i] 为长度在 [2^i, 2^(i+1)) 的空闲块数，
+     * 更长的计入最后一项
+     * @param  _orders         _hist 长度
+     * @return size_t          最长的连续空闲长度
+     * @note 默认实现不统计，只将 _hist 清零
+     */
+    virtual size_t    get_free_blocks(size_t* _hist, size_t _orders) const;
 };
 
 #endif /* SIMPLEKERNEL_ALLOCATOR_H */
@@ -0,0 +1,179 @@
+
+/**
+ * @file buddy.h
+ * @brief buddy 内存分配器头文件
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_BUDDY_H
+#define SIMPLEKERNEL_BUDDY_H
+
+#include "allocator.h"
+#include "common.h"
+#include "cstddef"
+#include "cstdint"
+
+/**
+ * @brief 使用 buddy 算法的分配器
+ * @note 以 2^order 页为单位管理内存，每一阶维护一个空闲链表
+ * 分配时从最小的满足要求的阶开始查找，不够小则对半分割
+ * 释放时与地址相邻的伙伴块合并，最多 ORDER_MAX+1 次链表操作
+ * 链表节点与阶数保存在独立的元数据中，不会访问被管理的内存本身，
+ * 因此可以管理尚未映射的物理内存
+ */
+class BUDDY : ALLOCATOR {
+private:
+    /// 最大阶数，2^18 页，即 1GB
+    static constexpr const size_t   ORDER_MAX  = 18;
+    /// 无效的页索引，作为链表结束标记
+    static constexpr const uint32_t NONE       = 0xFFFFFFFF;
+    /// 块头空闲标记，保存在 orders 的最高位
+    static constexpr const uint8_t  FREE       = 0x80;
+    /// 阶数掩码
+    static constexpr const uint8_t  ORDER_MASK = 0x7F;
+
+    /**
+     * @brief 空闲链表节点，以页索引代替指针
+     */
+    struct node_t {
+        /// 前一个空闲块
+        uint32_t prev;
+        /// 后一个空闲块
+        uint32_t next;
+    };
+
+    /// 每一阶空闲链表的头，保存块首页的索引
+    uint32_t free_list[ORDER_MAX + 1];
+    /// 每一阶空闲块的数量
+    size_t   free_blocks[ORDER_MAX + 1];
+    /// 链表节点，每页一项，只有空闲块的首页有效
+    node_t*  nodes;
+    /// 每页一项，空闲块的首页保存 FREE|order，其余为 0
+    uint8_t* orders;
+
+    /**
+     * @brief 计算能容纳 _len 页的最小阶数
+     * @param  _len            页数
+     * @return size_t          阶数
+     */
+    static size_t get_order(size_t _len);
+
+    /**
+     * @brief 将 _idx 开始的 2^_order 页加入空闲链表，不进行合并
+     * @param  _idx            块首页索引
+     * @param  _order          阶数
+     */
+    void          push(size_t _idx, size_t _order);
+
+    /**
+     * @brief 将 _idx 开始的空闲块从链表中移除
+     * @param  _idx            块首页索引
+     */
+    void          remove(size_t _idx);
+
+    /**
+     * @brief 释放 _idx 开始的 2^_order 页，并与伙伴合并
+     * @param  _idx            块首页索引
+     * @param  _order          阶数
+     */
+    void          merge(size_t _idx, size_t _order);
+
+    /**
+     * @brief 释放 _idx 开始的 _len 页，拆分为对齐的块后逐个合并
+     * @param  _idx            首页索引
+     * @param  _len            页数
+     */
+    void          free_range(size_t _idx, size_t _len);
+
+    /**
+     * @brief 查找包含 _idx 的空闲块
+     * @param  _idx            页索引
+     * @return size_t          空闲块首页索引，不存在返回 NONE
+     */
+    size_t        find_block(size_t _idx) const;
+
+protected:
+
+public:
+    /**
+     * @brief 计算管理 _len 页需要的元数据大小
+     * @param  _len            页数
+     * @return size_t          元数据大小，单位为 bytes
+     */
+    static size_t get_meta_size(size_t _len);
+
+    /**
+     * @brief 创建分配器
+     * @param  _name           分配器名称
+     * @param  _addr           开始地址
+     * @param  _len            长度，页
+     * @param  _meta           元数据地址，长度由 get_meta_size 计算
+     */
+    BUDDY(const char* _name, uintptr_t _addr, size_t _len, void* _meta);
+
+    ~BUDDY(void);
+
+    /**
+     * @brief 分配长度为 _len 页的内存
+     * @param  _len            页数
+     * @return uintptr_t       分配的内存起点地址
+     * @note 分配 2^order 页后，多余的尾部会立即归还
+     */
+    uintptr_t alloc(size_t _len) override;
+
+    /**
+     * @brief 在 _addr 处分配长度为 _len 页的内存
+     * @param  _addr           指定的地址
+     * @param  _len            页数
+     * @return true            成功
+     * @return false           失败
+     */
+    bool      alloc(uintptr_t _addr, size_t _len) override;
+
+    /**
+     * @brief 分配起始地址按 _align 对齐的 _len 页
+     * @param  _len            页数
+     * @param  _align          对齐，单位为 bytes
+     * @return uintptr_t       分配的内存起点地址
+     * @note 管理的起始地址已对齐时，2^order 块天然对齐，不需要多分配
+     */
+    uintptr_t alloc_aligned(size_t _len, size_t _align) override;
+
+    /**
+     * @brief 释放 _addr 处 _len 页的内存
+     * @param  _addr           要释放内存起点地址
+     * @param  _len            页数
+     */
+    void      free(uintptr_t _addr, size_t _len) override;
+
+    /**
+     * @brief 获取已使用页数
+     * @return size_t          已经使用的页数
+     */
+    size_t    get_used_count(void) const override;
+
+    /**
+     * @brief 获取未使用页数
+     * @return size_t          未使用的页数
+     */
+    size_t    get_free_count(void) const override;
+
+    /**
+     * @brief 统计空闲块
+     * @param  _hist           每一阶的空闲块数，超过 _orders 的计入最后一项
+     * @param  _orders         _hist 长度
+     * @return size_t          最长的连续空闲页数，相邻的空闲块会合并计算
+     */
+    size_t    get_free_blocks(size_t* _hist, size_t _orders) const override;
+};
+
+#endif /* SIMPLEKERNEL_BUDDY_H */
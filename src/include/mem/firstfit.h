@@ -40,51 +40,84 @@ private:
     /// 2^5==32
     static constexpr const uint64_t SHIFT = 5;
 #endif
-    /// 位图数组长度，设置为占用一个页，4kb，32768 个位，每个 bit
-    /// 代表一页，最大表示 128MB
-    static constexpr const size_t BITS_ARR_SIZE
-      = COMMON::PAGE_SIZE / BITS_PER_WORD;
+    /// 每个字的位数
+    static constexpr const uint64_t WORD_BITS = MASK + 1;
+    /// 位图长度，单位为字，由管理的页数决定
+    size_t     map_words;
     /// 位图，每一位表示一页内存，1 表示已使用，0 表示未使用
-    uintptr_t map[BITS_ARR_SIZE];
+    /// 超出管理范围的位置 1
+    uintptr_t* map;
+    /// 摘要位图，每一位表示 map 中的一个字，1 表示该字已全部使用
+    uintptr_t* summary;
 
     /**
-     * @brief 置位 _idx
-     * @param  _idx            要置位的索引
+     * @brief 生成字内从 _bit 开始连续 _len 位的掩码
+     * @param  _bit            起始位
+     * @param  _len            位数，_bit+_len 不超过字长
+     * @return uintptr_t       掩码
      */
-    void      set(size_t _idx);
+    static uintptr_t mask(size_t _bit, size_t _len);
 
     /**
-     * @brief 清零 _idx
-     * @param  _idx            要清零的索引
+     * @brief 根据 map[_word] 更新摘要位图
+     * @param  _word           map 中的字索引
      */
-    void      clr(size_t _idx);
+    void             update(size_t _word);
 
     /**
-     * @brief 测试 _idx
-     * @param  _idx            要测试的索引
-     * @return true            已使用
-     * @return false           未使用
+     * @brief 置位 [_idx, _idx+_len)
+     * @param  _idx            要置位的起始索引
+     * @param  _len            位数
+     * @note 按字整体写入
      */
-    bool      test(size_t _idx) const;
+    void             set_range(size_t _idx, size_t _len);
+
+    /**
+     * @brief 清零 [_idx, _idx+_len)
+     * @param  _idx            要清零的起始索引
+     * @param  _len            位数
+     * @note 按字整体写入
+     */
+    void             clr_range(size_t _idx, size_t _len);
+
+    /**
+     * @brief 测试 [_idx, _idx+_len) 中是否有已使用的位
+     * @param  _idx            起始索引
+     * @param  _len            位数
+     * @return true            有已使用的位
+     * @return false           全部未使用
+     */
+    bool             test_range(size_t _idx, size_t _len) const;
 
     /**
      * @brief 寻找连续 _len 个 _val 位，返回开始索引
      * @param  _len            连续
      * @param  _val            值
      * @return size_t          开始索引
+     * @note 整字匹配或整字不匹配时直接跳过，
+     * 其余情况使用 ctz/clz 计算字内的连续位
+     * 查找空闲位时通过摘要位图一次跳过多个已满的字
      */
-    size_t    find_len(size_t _len, bool _val) const;
+    size_t           find_len(size_t _len, bool _val) const;
 
 protected:
 
 public:
+    /**
+     * @brief 计算管理 _len 页需要的位图大小
+     * @param  _len            页数
+     * @return size_t          位图与摘要位图的大小，单位为 bytes
+     */
+    static size_t get_meta_size(size_t _len);
+
     /**
      * @brief 创建分配器
      * @param  _name           分配器名称
      * @param  _addr           开始地址
      * @param  _len            长度，页
+     * @param  _meta           位图地址，长度由 get_meta_size 计算
      */
-    FIRSTFIT(const char* _name, uintptr_t _addr, size_t _len);
+    FIRSTFIT(const char* _name, uintptr_t _addr, size_t _len, void* _meta);
 
     ~FIRSTFIT(void);
 
@@ -122,6 +155,14 @@ public:
      * @return size_t          未使用的页数
      */
     size_t    get_free_count(void) const override;
+
+    /**
+     * @brief 统计空闲块
+     * @param  _hist           _hist[i] 为长度在 [2^i, 2^(i+1)) 的连续空闲块数
+     * @param  _orders         _hist 长度
+     * @return size_t          最长的连续空闲页数
+     */
+    size_t    get_free_blocks(size_t* _hist, size_t _orders) const override;
 };
 
 #endif /* SIMPLEKERNEL_FIRTSTFIT_H */
@@ -18,18 +18,47 @@
 #define SIMPLEKERNEL_HEAP_H
 
 #include "allocator.h"
+#include "common.h"
 #include "cstddef"
 #include "cstdint"
+#include "kmem_cache.h"
 #include "slab.h"
 
 /**
  * @brief 堆抽象
+ * @note kmalloc 不超过 KMEM_CACHE_MAX_SIZE 的请求由按长度分级的对象缓存处理，
+ * 常见的分配与释放只访问当前 CPU 的 magazine，更大的由 SLAB 处理，
+ * 超过 KMALLOC_LARGE 的直接从 PMM 分配整页
  */
 class HEAP {
 private:
+    /// kmalloc 对象缓存数，长度见 heap.cpp 中的 KMALLOC_SIZES
+    static constexpr const size_t KMALLOC_CACHES = 14;
+    /// 超过此长度的 kmalloc 直接分配整页，即 SLAB 支持的最大长度
+    static constexpr const size_t KMALLOC_LARGE  = 64 * COMMON::KB;
+
     // 堆分配器
-    ALLOCATOR* allocator_kernel;
-    ALLOCATOR* allocator_non_kernel;
+    ALLOCATOR*    allocator_kernel;
+    ALLOCATOR*    allocator_non_kernel;
+    /// kmalloc 的对象缓存
+    kmem_cache_t* kmalloc_caches[KMALLOC_CACHES];
+
+    /**
+     * @brief 分配整页
+     * @param  _byte           要申请的 bytes
+     * @return void*           申请到的地址，页对齐
+     * @note 物理内存已经被直接映射，连续的页可以直接使用，
+     * 页数记录在首页的页描述符中
+     */
+    void*         large_alloc(size_t _byte);
+
+    /**
+     * @brief 释放 large_alloc 分配的整页
+     * @param  _p              要释放的内存地址
+     * @return true            已释放
+     * @return false           不是 large_alloc 分配的
+     */
+    bool          large_free(void* _p);
 
 protected:
 
@@ -72,6 +101,19 @@ public:
      * @param  _p              要释放的内存地址
      */
     void         free(void* _p);
+
+    /**
+     * @brief 归还堆中空闲的整段内存
+     * @return size_t          归还的页数
+     * @note 注册为 PMM 的回收函数，内存不足时调用
+     */
+    size_t       shrink(void);
+
+    /**
+     * @brief 获取 kmalloc 对象缓存的统计信息
+     * @return kmem_stat_t     所有长度的统计信息之和
+     */
+    kmem_stat_t  get_kmalloc_stat(void) const;
 };
 
 #endif /* SIMPLEKERNEL_HEAP_H */
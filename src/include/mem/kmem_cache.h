@@ -0,0 +1,286 @@
+
+/**
+ * @file kmem_cache.h
+ * @brief 对象缓存头文件
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_KMEM_CACHE_H
+#define SIMPLEKERNEL_KMEM_CACHE_H
+
+#include "common.h"
+#include "cstddef"
+#include "cstdint"
+
+/// 对象的最大长度
+static constexpr const size_t KMEM_CACHE_MAX_SIZE = 2 * COMMON::PAGE_SIZE;
+
+/**
+ * @brief 对象缓存统计信息
+ */
+struct kmem_stat_t {
+    /// 分配次数
+    size_t alloc;
+    /// 直接从 CPU 缓存中得到的次数
+    size_t alloc_hit;
+    /// 释放次数
+    size_t free;
+    /// 直接放入 CPU 缓存的次数
+    size_t free_hit;
+    /// 从 slab 补充的次数
+    size_t refill;
+    /// 归还给 slab 的次数
+    size_t flush;
+};
+
+/**
+ * @brief 对象缓存
+ * 每个 slab 是一段连续的页，开头为 slab_t，之后是等长的对象
+ * 空闲对象的第一个字保存下一个空闲对象的地址，组成 slab 内的空闲链表，
+ * 分配与释放只是链表的出栈与入栈，对象没有额外的头部
+ * 每个 CPU 在 slab 之前有一个 magazine，大部分分配与释放不访问共享的 slab
+ * @note slab 的每一页在页描述符中记录页序号，释放时由对象地址找到 slab
+ */
+class kmem_cache_t {
+private:
+    /// magazine 容量
+    static constexpr const size_t MAG_SIZE       = 16;
+    /// magazine 每次补充/归还的对象数
+    static constexpr const size_t MAG_BATCH      = MAG_SIZE / 2;
+    /// 每个 slab 至少容纳的对象数
+    static constexpr const size_t SLAB_MIN_OBJS  = 8;
+    /// 每个 slab 最多占用的页数
+    static constexpr const size_t SLAB_MAX_PAGES = 16;
+    /// 最多保留的空 slab 数，超过时归还给 PMM
+    static constexpr const size_t FREE_MAX       = 1;
+
+    /**
+     * @brief slab 头，位于 slab 首页开头
+     */
+    struct slab_t {
+        /// 所属的缓存
+        kmem_cache_t* cache;
+        /// 所在链表的前一项
+        slab_t*       prev;
+        /// 所在链表的后一项
+        slab_t*       next;
+        /// 空闲对象链表
+        void*         freelist;
+        /// 已分配的对象数
+        size_t        inuse;
+    };
+
+    /**
+     * @brief 每个 CPU 的 magazine
+     * 栈，栈顶为最近释放的热对象，栈底为冷对象
+     * 空时从 slab 补充一批，满时将栈底的一批归还给 slab
+     */
+    struct magazine_t {
+        /// 缓存的对象
+        void*       objs[MAG_SIZE];
+        /// 缓存的对象数
+        size_t      count;
+        /// 统计信息
+        kmem_stat_t stat;
+    };
+
+    /// 名称
+    const char*                   name;
+    /// 对象长度，已经按 align 对齐
+    size_t                        size;
+    /// 对象对齐
+    size_t                        align;
+    /// 第一个对象在 slab 中的偏移
+    size_t                        offset;
+    /// 每个 slab 的页数
+    size_t                        pages;
+    /// 每个 slab 的对象数
+    size_t                        objs;
+    /// 所有对象都已分配的 slab
+    slab_t*                       full;
+    /// 部分对象已分配的 slab
+    slab_t*                       partial;
+    /// 没有对象被分配的 slab
+    slab_t*                       empty;
+    /// 空 slab 数
+    size_t                        empty_count;
+    /// slab 总数
+    size_t                        slab_count;
+    /// 从 slab 中分配出去的对象数，包括 magazine 中的
+    size_t                        inuse;
+    /// 每个 CPU 的 magazine
+    magazine_t                    mags[COMMON::CPU_MAX];
+
+    /**
+     * @brief 将 slab 加入链表头
+     * @param  _list           链表
+     * @param  _slab           要加入的 slab
+     */
+    static void                   list_add(slab_t** _list, slab_t* _slab);
+
+    /**
+     * @brief 从链表中删除 slab
+     * @param  _list           链表
+     * @param  _slab           要删除的 slab
+     */
+    static void                   list_del(slab_t** _list, slab_t* _slab);
+
+    /**
+     * @brief 获取对象所在的 slab
+     * @param  _obj            对象地址
+     * @return slab_t*         所在的 slab，不在 slab 中时返回 nullptr
+     */
+    static slab_t*                get_slab(const void* _obj);
+
+    /**
+     * @brief 分配一个新的 slab，加入 empty 链表
+     * @return slab_t*         新的 slab，内存不足时返回 nullptr
+     */
+    slab_t*                       grow(void);
+
+    /**
+     * @brief 将 slab 的页归还给 PMM
+     * @param  _slab           要归还的 slab，需要已经不在链表中
+     */
+    void                          destroy(slab_t* _slab);
+
+    /**
+     * @brief 从 slab 中分配一个对象
+     * @return void*           对象地址，内存不足时返回 nullptr
+     */
+    void*                         slab_alloc(void);
+
+    /**
+     * @brief 将对象释放回 slab
+     * @param  _obj            要释放的对象
+     */
+    void                          slab_free(void* _obj);
+
+    /**
+     * @brief 获取当前 CPU 的 magazine
+     * @return magazine_t*     magazine
+     */
+    magazine_t*                   get_mag(void);
+
+    /**
+     * @brief 将 magazine 栈底的对象归还给 slab
+     * @param  _mag            magazine
+     * @param  _count          归还的对象数
+     */
+    void                          mag_flush(magazine_t* _mag, size_t _count);
+
+public:
+    /**
+     * @brief 构造函数
+     * @param  _name           名称
+     * @param  _size           对象长度，不超过 KMEM_CACHE_MAX_SIZE
+     * @param  _align          对象对齐，2 的幂且不超过页大小，0 表示字长
+     */
+    kmem_cache_t(const char* _name, size_t _size, size_t _align);
+
+    kmem_cache_t(const kmem_cache_t&)            = delete;
+    kmem_cache_t& operator=(const kmem_cache_t&) = delete;
+
+    /**
+     * @brief 析构函数，归还所有 slab
+     * @note 所有对象都应该已经释放
+     */
+    ~kmem_cache_t(void);
+
+    /**
+     * @brief 分配一个对象
+     * @return void*           对象地址，内存不足时返回 nullptr
+     * @note 优先从当前 CPU 的 magazine 中分配
+     */
+    void*                alloc(void);
+
+    /**
+     * @brief 释放一个对象
+     * @param  _obj            由 alloc 分配的对象
+     * @note 放入当前 CPU 的 magazine，满时归还一批给 slab
+     */
+    void                 free(void* _obj);
+
+    /**
+     * @brief 归还当前 CPU 的 magazine 与所有空 slab
+     * @return size_t          归还的页数
+     */
+    size_t               shrink(void);
+
+    /**
+     * @brief 获取名称
+     * @return const char*     名称
+     */
+    const char*          get_name(void) const;
+
+    /**
+     * @brief 获取对齐后的对象长度
+     * @return size_t          对象长度
+     */
+    size_t               get_size(void) const;
+
+    /**
+     * @brief 获取已分配的对象数
+     * @return size_t          对象数，包括 magazine 中的
+     */
+    size_t               get_inuse(void) const;
+
+    /**
+     * @brief 获取 slab 数
+     * @return size_t          slab 数
+     */
+    size_t               get_slab_count(void) const;
+
+    /**
+     * @brief 获取所有 CPU 的 magazine 的统计信息
+     * @return kmem_stat_t     统计信息之和
+     */
+    kmem_stat_t          get_stat(void) const;
+
+    /**
+     * @brief 获取对象所属的缓存
+     * @param  _obj            对象地址
+     * @return kmem_cache_t*   所属的缓存，不在 slab 中时返回 nullptr
+     */
+    static kmem_cache_t* find(const void* _obj);
+};
+
+/**
+ * @brief 创建对象缓存
+ * @param  _name           名称
+ * @param  _size           对象长度，不超过 KMEM_CACHE_MAX_SIZE
+ * @param  _align          对象对齐，2 的幂且不超过页大小，0 表示字长
+ * @return kmem_cache_t*   创建的缓存，参数错误或内存不足时返回 nullptr
+ */
+kmem_cache_t* kmem_cache_create(const char* _name, size_t _size, size_t _align);
+
+/**
+ * @brief 销毁对象缓存
+ * @param  _cache          要销毁的缓存，所有对象都应该已经释放
+ */
+void          kmem_cache_destroy(kmem_cache_t* _cache);
+
+/**
+ * @brief 从缓存中分配一个对象
+ * @param  _cache          缓存
+ * @return void*           对象地址，内存不足时返回 nullptr
+ */
+void*         kmem_cache_alloc(kmem_cache_t* _cache);
+
+/**
+ * @brief 将对象释放回缓存
+ * @param  _cache          缓存
+ * @param  _obj            要释放的对象
+ */
+void          kmem_cache_free(kmem_cache_t* _cache, void* _obj);
+
+#endif /* SIMPLEKERNEL_KMEM_CACHE_H */
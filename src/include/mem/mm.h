@@ -0,0 +1,231 @@
+
+/**
+ * @file mm.h
+ * @brief 地址空间头文件
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_MM_H
+#define SIMPLEKERNEL_MM_H
+
+#include "cstddef"
+#include "cstdint"
+#include "map"
+#include "vmm.h"
+
+/// mmap 的选项，与页属性一起传入，建立区域时立即映射所有页
+static constexpr const uint32_t MM_MAP_POPULATE       = 1U << 31;
+/// 缺页时默认一起映射的页数，包括缺页的页
+static constexpr const size_t   MM_FAULT_AROUND_PAGES = 16;
+/// 一次批量映射的最大页数
+static constexpr const size_t   MM_BATCH_PAGES        = 64;
+
+/**
+ * @brief 虚拟内存区域，描述一段页对齐的 [start, end)
+ */
+struct vma_t {
+    /**
+     * @brief 后备类型
+     */
+    enum type_t : uint8_t {
+        /// 匿名内存，读缺页时映射共享的零页，第一次写入时分配清零的物理页
+        ANON,
+        /// 固定的物理内存，建立区域时立即映射
+        PHYS,
+        /// 保护页，不会被映射，访问即错误
+        GUARD,
+    };
+    /// 起始地址
+    uintptr_t start;
+    /// 结束地址，不包括在区域内
+    uintptr_t end;
+    /// 页属性，VMM_PAGE_*
+    uint32_t  flag;
+    /// 后备类型
+    type_t    type;
+    /// PHYS 区域中 start 对应的物理地址
+    uintptr_t pa;
+    /// PHYS 区域是否对映射的页持有引用，由 clone 设置
+    bool      ref;
+};
+
+/**
+ * @brief 地址空间，由页目录与按起始地址排序的 VMA 红黑树组成
+ * @note 区域之间不重叠，相邻且属性相同的区域会被合并
+ */
+class mm_t {
+private:
+    typedef mystl::map<uintptr_t, vma_t> vma_tree_t;
+
+    /// 当前使用的地址空间
+    static mm_t*     current;
+    /// 所有地址空间共享的只读零页，每个映射持有一个引用
+    static uintptr_t zero_page;
+
+    /// 页目录
+    pt_t             pgd;
+    /// 页目录是否由 mm_t 创建，析构时释放
+    bool             own_pgd;
+    /// 缺页时一起映射的页数
+    size_t           fault_around;
+    /// 以起始地址为键的区域
+    vma_tree_t       vmas;
+
+    /**
+     * @brief 获取零页，第一次使用时分配
+     * @return uintptr_t       零页的物理地址，失败返回 0
+     */
+    static uintptr_t     get_zero_page(void);
+
+    /**
+     * @brief 两个区域能否合并
+     * @param  _prev           前一个区域
+     * @param  _next           后一个区域
+     * @return true            首尾相接且属性相同
+     * @return false           不能合并
+     */
+    static bool          mergeable(const vma_t& _prev, const vma_t& _next);
+
+    /**
+     * @brief 在 _addr 处将区域一分为二
+     * @param  _it             要分割的区域
+     * @param  _addr           分割地址，在区域内部且页对齐
+     * @return vma_tree_t::iterator 后一半区域
+     */
+    vma_tree_t::iterator split(vma_tree_t::iterator _it, uintptr_t _addr);
+
+    /**
+     * @brief 处理写入只读共享页的缺页
+     * @param  _vma            所在区域
+     * @param  _va             页地址
+     * @param  _pa             当前映射的物理页
+     * @return true            已经映射为可写
+     * @return false           内存不足
+     * @note 匿名页只有自己引用时直接改为可写，否则复制一份，
+     * 零页不需要复制，换为新分配的清零页
+     */
+    bool                 cow(const vma_t* _vma, uintptr_t _va, uintptr_t _pa);
+
+    /**
+     * @brief 批量映射匿名区域中 [_start, _end) 内还没有映射的页
+     * @param  _vma            所在区域
+     * @param  _start          起始地址，页对齐
+     * @param  _end            结束地址，页对齐
+     * @param  _write          是否为写访问，读访问映射零页
+     * @return size_t          映射的页数
+     */
+    size_t               populate(const vma_t* _vma, uintptr_t _start,
+                                  uintptr_t _end, bool _write);
+
+    /**
+     * @brief 取消区域的映射，释放匿名页
+     * @param  _vma            要释放的区域
+     */
+    void                 release(const vma_t& _vma);
+
+public:
+    /**
+     * @brief 构造函数
+     * @param  _pgd            使用的页目录，不由 mm_t 释放
+     */
+    explicit mm_t(pt_t _pgd);
+
+    mm_t(const mm_t&)            = delete;
+    mm_t& operator=(const mm_t&) = delete;
+
+    /**
+     * @brief 析构函数，释放所有区域
+     */
+    ~mm_t(void);
+
+    /**
+     * @brief 复制地址空间，私有页写时复制
+     * @return mm_t*           新的地址空间，拥有自己的页目录，失败返回 nullptr
+     */
+    mm_t*        clone(void) const;
+
+    /**
+     * @brief 获取当前地址空间
+     * @return mm_t*           当前地址空间，没有时为 nullptr
+     */
+    static mm_t* get_current(void);
+
+    /**
+     * @brief 切换到此地址空间
+     */
+    void         switch_to(void);
+
+    /**
+     * @brief 获取页目录
+     * @return pt_t            页目录
+     */
+    pt_t         get_pgd(void) const;
+
+    /**
+     * @brief 设置缺页时一起映射的页数
+     * @param  _pages          页数，2 的幂且不超过 MM_BATCH_PAGES，1 表示关闭
+     */
+    void         set_fault_around(size_t _pages);
+
+    /**
+     * @brief 获取缺页时一起映射的页数
+     * @return size_t          页数
+     */
+    size_t       get_fault_around(void) const;
+
+    /**
+     * @brief 获取区域数量
+     * @return size_t          区域数量
+     */
+    size_t       get_vma_count(void) const;
+
+    /**
+     * @brief 查找包含 _addr 的区域，O(log n)
+     * @param  _addr           虚拟地址
+     * @return const vma_t*    找到的区域，没有时为 nullptr
+     */
+    const vma_t* find_vma(uintptr_t _addr) const;
+
+    /**
+     * @brief 建立区域，并与相邻区域合并
+     * @param  _addr           起始地址，页对齐
+     * @param  _len            长度，页对齐
+     * @param  _flag           页属性，可以加上 MM_MAP_POPULATE
+     * @param  _type           后备类型
+     * @param  _pa             PHYS 区域的物理地址
+     * @return true            成功
+     * @return false           参数错误或与已有区域、内核映射重叠
+     */
+    bool mmap(uintptr_t _addr, size_t _len, uint32_t _flag,
+              vma_t::type_t _type, uintptr_t _pa = 0);
+
+    /**
+     * @brief 删除 [_addr, _addr + _len) 内的区域，部分覆盖的区域会被分割
+     * @param  _addr           起始地址，页对齐
+     * @param  _len            长度，页对齐
+     * @return true            成功
+     * @return false           参数错误
+     */
+    bool munmap(uintptr_t _addr, size_t _len);
+
+    /**
+     * @brief 处理缺页，匿名区域会同时映射 _addr 所在的对齐窗口中
+     * 还没有映射的页：读缺页映射零页，写缺页使用预先清零的页
+     * @param  _addr           缺页地址
+     * @param  _write          是否为写访问
+     * @return true            已经建立映射，或完成了写时复制
+     * @return false           地址不在区域内或权限不足
+     */
+    bool fault(uintptr_t _addr, bool _write);
+};
+
+#endif /* SIMPLEKERNEL_MM_H */
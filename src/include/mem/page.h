@@ -0,0 +1,55 @@
+/**
+ * @file page.h
+ * @brief 物理页描述符头文件
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_PAGE_H
+#define SIMPLEKERNEL_PAGE_H
+
+#include "cstddef"
+#include "cstdint"
+
+/**
+ * @brief 物理页描述符，每个物理页一项
+ * 由 PMM 在初始化时按页帧号(PFN)建立数组，
+ * 通过 PMM::pfn_to_page/page_to_pfn 相互转换
+ * @note 链表以数组下标代替指针，使 32/64 位下大小均为 16 bytes
+ */
+struct page_t {
+    /// 无效的下标，作为链表结束标记
+    static constexpr const uint32_t NONE     = 0xFFFFFFFF;
+
+    /// 不受分配器管理的页，如内存空洞、内核及其元数据
+    static constexpr const uint16_t RESERVED = 1 << 0;
+    /// 已分配块的首页，order 有效
+    static constexpr const uint16_t HEAD     = 1 << 1;
+    /// kmem_cache 的 slab 页，prev 为在 slab 中的页序号
+    static constexpr const uint16_t SLAB     = 1 << 2;
+    /// kmalloc 直接分配的整页的首页，prev 为页数
+    static constexpr const uint16_t KMALLOC  = 1 << 3;
+
+    /// 链表中的前一项，供页的所有者使用
+    uint32_t prev;
+    /// 链表中的后一项
+    uint32_t next;
+    /// 引用计数，空闲页为 0
+    uint32_t ref;
+    /// 标志位
+    uint16_t flags;
+    /// 所在块的阶数，块长度不超过 2^order 页，首页有效
+    uint8_t  order;
+};
+
+static_assert(sizeof(page_t) <= 32, "page_t should be no larger than 32 bytes");
+
+#endif /* SIMPLEKERNEL_PAGE_H */
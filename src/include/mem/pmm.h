@@ -18,25 +18,163 @@
 #define SIMPLEKERNEL_PMM_H
 
 #include "allocator.h"
+#include "buddy.h"
+#include "common.h"
+#include "cpu.hpp"
 #include "cstddef"
 #include "cstdint"
 #include "firstfit.h"
+#include "page.h"
 
 /**
  * @brief 物理内存管理接口
  * 对物理内存的管理来说
- * 1. 管理所有的物理内存，不论是否被机器保留/无法访问
- * 2. 内存开始地址与长度由 bootloader 给出: x86 下为 grub, riscv 下为 opensbi
+ * 1. 只管理可用的物理内存，保留区域不会被分配
+ * 2. 内存区域由 bootloader 给出: x86 下为 grub, riscv 下为 opensbi
+ *    每个区域使用独立的分配器，分配时依次尝试
  * 3.
  *    不关心内存是否被使用，但是默认的物理内存分配空间从内核结束后开始
- *    如果由体系结构需要分配内核开始前内存空间的，则尽量避免
+ *    内核开始前的内存不会被分配
  * 4. 最管理单位为页
+ * 5. 内核空间分配器的元数据从内核结束处开始依次分配(early_alloc)，
+ *    这部分内存在分配器创建完成后与内核一起被标记为已使用
+ * 6. 每个物理页有一个 page_t 描述符，按页帧号索引，
+ *    分配时引用计数置 1，释放时清零
+ *    描述符数组与非内核空间分配器的元数据随内存大小增长，
+ *    从地址最低的足够大的区域开头划出(meta_alloc)，不属于任何分配器
+ * 7. 最大的区域末尾保留 CMA_SIZE 连续内存，
+ *    只有对齐分配在其它区域失败时才会使用
+ * 8. 内存分为 KERNEL/DMA32/NORMAL 三个 zone，
+ *    分配时按顺序回退，空闲页低于低水位时在空闲时进行回收
  */
 class PMM {
+public:
+    /**
+     * @brief 内存区域类型
+     */
+    enum zone_type_t {
+        /// 内核空间，大小为 KERNEL_ZONE_SIZE
+        ZONE_KERNEL,
+        /// DMA32_END 以下的其余内存
+        ZONE_DMA32,
+        /// DMA32_END 以上的内存
+        ZONE_NORMAL,
+        /// zone 数量
+        ZONE_MAX,
+    };
+
+    /**
+     * @brief 回收函数，在内存不足时被调用
+     * @param  _pages          希望回收的页数
+     * @return size_t          实际回收的页数
+     */
+    typedef size_t (*shrinker_t)(size_t _pages);
+
+    /**
+     * @brief 页缓存统计信息
+     */
+    struct pcp_stat_t {
+        /// 单页分配次数
+        size_t alloc;
+        /// 直接从缓存中得到的次数
+        size_t hit;
+        /// 从分配器补充的次数
+        size_t refill;
+        /// 归还给分配器的次数
+        size_t drain;
+    };
+
 private:
+    /**
+     * @brief 可选的物理内存分配器类型
+     */
+    enum allocator_type_t {
+        /// 首次适应，使用位图
+        FIRSTFIT_ALLOCATOR,
+        /// buddy，按 2 的幂次管理
+        BUDDY_ALLOCATOR,
+    };
+
+    /// 使用的分配器类型
+    static constexpr const allocator_type_t ALLOCATOR_TYPE = BUDDY_ALLOCATOR;
+    /// 内核空间 zone 的大小
+    static constexpr const size_t           KERNEL_ZONE_SIZE
+      = COMMON::KERNEL_SPACE_SIZE;
+    /// 启动阶段内存(包括内核)最多占用的大小，剩余的内核空间留给页表等使用
+    static constexpr const size_t           EARLY_SIZE
+      = KERNEL_ZONE_SIZE / 2;
+    /// DMA32 zone 的结束地址
+    static constexpr const uint64_t         DMA32_END        = 0x100000000;
+    /// 低水位为 zone 页数的 1/WMARK_LOW_RATIO
+    static constexpr const size_t           WMARK_LOW_RATIO  = 64;
+    /// 高水位为 zone 页数的 1/WMARK_HIGH_RATIO
+    static constexpr const size_t           WMARK_HIGH_RATIO = 32;
+    /// 最多可以注册的回收函数数量
+    static constexpr const size_t           SHRINKER_MAX     = 8;
+    /// 最大内存区域数
+    static constexpr const size_t           REGION_MAX       = 16;
+    /// 页缓存每次补充/归还的页数
+    static constexpr const size_t           PCP_BATCH        = 32;
+    /// 页缓存容量，需要为 2 的幂
+    static constexpr const size_t           PCP_SIZE         = PCP_BATCH * 2;
+    /// 预先清零的页数
+    static constexpr const size_t           ZERO_POOL_SIZE   = 32;
+    /// 保留的连续内存大小
+    static constexpr const size_t           CMA_SIZE         = 16 * COMMON::MB;
+    /// 保留的连续内存的对齐
+    static constexpr const size_t           CMA_ALIGN        = 2 * COMMON::MB;
+
+    /**
+     * @brief 每个 CPU 的单页缓存
+     * 环形队列，队尾为最近释放的热页，队首为冷页
+     * 分配时从队尾取，缓存满时从队首归还
+     */
+    struct pcp_t {
+        /// 缓存的页地址
+        uintptr_t  pages[PCP_SIZE];
+        /// 队首索引
+        size_t     first;
+        /// 缓存的页数
+        size_t     count;
+        /// 统计信息
+        pcp_stat_t stat;
+    };
+
+    /**
+     * @brief 物理内存区域
+     */
+    struct region_t {
+        /// 起始地址
+        uintptr_t   start;
+        /// 长度，单位为 bytes
+        size_t      length;
+        /// 区域的分配器
+        ALLOCATOR*  allocator;
+        /// 所属的 zone
+        zone_type_t zone;
+    };
+
+    /**
+     * @brief zone 信息
+     */
+    struct zone_t {
+        /// 名称
+        const char* name;
+        /// 管理的页数
+        size_t      pages;
+        /// 低水位，空闲页低于此值时回收，回退时也不会使用低于此值的 zone
+        size_t      low;
+        /// 高水位，回收的目标
+        size_t      high;
+        /// 低于低水位，等待 balance_zones 回收
+        bool        pending;
+        /// 回收后仍低于高水位，回到高水位之前不再请求回收
+        bool        hold;
+    };
+
     /// 物理内存开始地址
     uintptr_t  start;
-    /// 物理内存长度，单位为 bytes
+    /// 管理的物理内存长度，单位为 bytes
     size_t     length;
     /// 物理内存页数
     size_t     total_pages;
@@ -49,11 +187,206 @@ private:
     /// 非内核空间大小，单位为 bytes
     size_t     non_kernel_space_length;
 
-    /// 内核空间不会位于内存中间，导致出现非内核空间被切割为两部分的情况
     /// 物理内存分配器，分配内核空间
     ALLOCATOR* kernel_space_allocator;
-    /// 物理内存分配器，分配非内核空间
-    ALLOCATOR* allocator;
+    /// 非内核空间的内存区域，按地址排序
+    region_t   regions[REGION_MAX];
+    /// 内存区域数
+    size_t     region_count;
+    /// 保留的连续内存，长度为 0 表示没有
+    region_t   cma;
+    /// zone 信息
+    zone_t     zones[ZONE_MAX];
+    /// 回收函数
+    shrinker_t shrinkers[SHRINKER_MAX];
+    /// 回收函数数量
+    size_t     shrinker_count;
+    /// 每个 CPU 的页缓存，[0] 为非内核空间，[1] 为内核空间
+    pcp_t      pcp[COMMON::CPU_MAX][2];
+    /// 已清零的内核空间页
+    uintptr_t  zero_pool[ZERO_POOL_SIZE];
+    /// zero_pool 中的页数
+    size_t     zero_count;
+    /// 启动阶段已分配内存的结束地址
+    uintptr_t  early_end;
+    /// 从区域中划出的元数据内存已分配部分的结束地址
+    uintptr_t  meta_end;
+    /// 从区域中划出的元数据内存的结束地址
+    uintptr_t  meta_limit;
+    /// 页描述符数组
+    page_t*    pages;
+    /// pages[0] 对应的页帧号
+    size_t     pages_base;
+    /// 页描述符数量
+    size_t     pages_count;
+
+    /**
+     * @brief 在内核结束后分配启动阶段使用的内存
+     * @param  _len            长度，单位为 bytes
+     * @return uintptr_t       分配的内存起始地址
+     * @note 在分配器创建之前使用，只分配不回收，不会清零
+     */
+    uintptr_t  early_alloc(size_t _len);
+
+    /**
+     * @brief 在 init_pages 划出的内存中分配元数据
+     * @param  _len            长度，单位为 bytes
+     * @return uintptr_t       分配的内存起始地址
+     * @note 只分配不回收，不会清零
+     */
+    uintptr_t  meta_alloc(size_t _len);
+
+    /**
+     * @brief 计算分配器本身与元数据的大小
+     * @param  _len            分配器管理的页数
+     * @return size_t          大小，单位为 bytes
+     */
+    size_t     get_allocator_size(size_t _len) const;
+
+    /**
+     * @brief 根据 ALLOCATOR_TYPE 创建分配器
+     * @param  _kernel         是否为内核空间分配器
+     * @param  _addr           开始地址
+     * @param  _len            长度，页
+     * @return ALLOCATOR*      创建的分配器
+     * @note 内核空间分配器使用 early_alloc，其余使用 meta_alloc
+     */
+    ALLOCATOR* create_allocator(bool _kernel, uintptr_t _addr, size_t _len);
+
+    /**
+     * @brief 建立页描述符数组，覆盖内核空间到最后一个区域结束
+     * @note 数组与非内核空间分配器的元数据从区域中划出，
+     *       需要在 reserve_cma 之后、创建分配器之前调用
+     */
+    void       init_pages(void);
+
+    /**
+     * @brief 更新 [_addr, _addr+_len 页) 的页描述符
+     * @param  _addr           开始地址
+     * @param  _len            页数
+     * @param  _alloc          true 为分配，false 为释放
+     */
+    void       set_pages(uintptr_t _addr, size_t _len, bool _alloc);
+
+    /**
+     * @brief 根据 bootloader 提供的信息计算非内核空间的内存区域
+     * 可用区域去掉保留区域、内核空间以及内核之前的内存后，
+     * 按页对齐保存到 regions
+     */
+    void       find_regions(void);
+
+    /**
+     * @brief 按地址插入一个区域，跨过 DMA32_END 时拆分为两个
+     * @param  _start          起始地址
+     * @param  _end            结束地址
+     * @return true            成功
+     * @return false           区域数已满
+     */
+    bool       add_region(uintptr_t _start, uintptr_t _end);
+
+    /**
+     * @brief 计算各 zone 的页数与水位
+     */
+    void       init_zones(void);
+
+    /**
+     * @brief 获取 zone 中分配器的空闲页数，不包括页缓存
+     * @param  _zone           zone
+     * @return size_t          空闲页数
+     */
+    size_t     zone_free_count(zone_type_t _zone) const;
+
+    /**
+     * @brief 只在 _zone 中分配
+     * @param  _zone           zone
+     * @param  _len            页数
+     * @return uintptr_t       分配的内存起始地址
+     */
+    uintptr_t  zone_alloc(zone_type_t _zone, size_t _len);
+
+    /**
+     * @brief 从 _zone 开始按回退顺序分配
+     * 先只使用高于低水位的 zone，都失败时回收后再忽略水位重试，
+     * 分配后 zone 低于低水位时请求 balance_zones 回收到高水位
+     * @param  _zone           首选的 zone
+     * @param  _len            页数
+     * @param  _reclaim        失败时是否回收后重试
+     * @return uintptr_t       分配的内存起始地址
+     */
+    uintptr_t  fallback_alloc(zone_type_t _zone, size_t _len, bool _reclaim);
+
+    /**
+     * @brief 从最大的区域末尾划出保留的连续内存
+     * @note 区域长度不足 CMA_SIZE 的 4 倍时不保留
+     */
+    void       reserve_cma(void);
+
+    /**
+     * @brief 查找 _addr 所在的内存区域
+     * @param  _addr           地址
+     * @return region_t*       所在的区域，包括 cma，未找到返回 nullptr
+     */
+    region_t*  find_region(uintptr_t _addr);
+
+    /**
+     * @brief 获取当前 CPU 的页缓存
+     * @param  _kernel         是否为内核空间
+     * @return pcp_t*          页缓存
+     */
+    pcp_t*     get_pcp(bool _kernel);
+
+    /**
+     * @brief 从分配器补充 PCP_BATCH 页到页缓存
+     * @param  _pcp            页缓存
+     * @param  _kernel         是否为内核空间
+     * @note 优先分配连续的页，失败时逐页分配
+     */
+    void       pcp_refill(pcp_t* _pcp, bool _kernel);
+
+    /**
+     * @brief 将页缓存队首的 _count 页归还给分配器
+     * @param  _pcp            页缓存
+     * @param  _count          页数
+     */
+    void       pcp_drain(pcp_t* _pcp, size_t _count);
+
+    /**
+     * @brief 分配一页，优先使用页缓存
+     * @param  _kernel         是否为内核空间
+     * @return uintptr_t       分配的内存起始地址
+     */
+    uintptr_t  pcp_alloc(bool _kernel);
+
+    /**
+     * @brief 释放一页到页缓存
+     * @param  _addr           要释放的地址
+     * @param  _hot            true 放入队尾，false 放入队首
+     */
+    void       pcp_free(uintptr_t _addr, bool _hot);
+
+    /**
+     * @brief 获取所有页缓存中的页数
+     * @return size_t          页数
+     */
+    size_t     get_pcp_count(void) const;
+
+    /**
+     * @brief 以字为单位将一页清零
+     * @param  _addr           页地址，需要可以直接访问
+     */
+    static void clear_page(uintptr_t _addr);
+
+    /**
+     * @brief 将已清零的页全部归还给分配器
+     */
+    void       zero_drain(void);
+
+    /**
+     * @brief 不经过页缓存，直接释放到对应的分配器
+     * @param  _addr           要释放的地址
+     * @param  _len            页数
+     */
+    void       allocator_free(uintptr_t _addr, size_t _len);
 
     /**
      * @brief 将 multiboot2/dtb 信息移动到内核空间
@@ -78,11 +411,29 @@ public:
     bool        init(void);
 
     /**
-     * @brief 获取物理内存长度
-     * @return size_t          物理内存长度
+     * @brief 获取管理的物理内存长度
+     * @return size_t          物理内存长度，包括内核空间与所有区域
      */
     size_t      get_pmm_length(void) const;
 
+    /**
+     * @brief 获取管理的物理内存的起始地址
+     * @return uintptr_t       起始地址，即最低的区域的起始地址
+     */
+    uintptr_t   get_pmm_start(void) const;
+
+    /**
+     * @brief 获取管理的物理内存的结束地址
+     * @return uintptr_t       结束地址，内核空间到此地址之间可能有空洞
+     */
+    uintptr_t   get_pmm_end(void) const;
+
+    /**
+     * @brief 获取启动阶段已分配内存的结束地址
+     * @return uintptr_t        结束地址，此前的内存均已被标记为使用
+     */
+    uintptr_t   get_early_end(void) const;
+
     /**
      * @brief 获取内核空间起始地址
      * @return uintptr_t        内核空间起始地址
@@ -97,13 +448,13 @@ public:
 
     /**
      * @brief 获取非内核空间起始地址
-     * @return uintptr_t        非内核空间起始地址
+     * @return uintptr_t        非内核空间起始地址，即第一个区域的起始地址
      */
     uintptr_t   get_non_kernel_space_start(void) const;
 
     /**
      * @brief 获取非内核空间大小，单位为 byte
-     * @return size_t           非内核空间大小
+     * @return size_t           非内核空间大小，即所有区域的总长度
      */
     size_t      get_non_kernel_space_length(void) const;
 
@@ -119,9 +470,19 @@ public:
      */
     size_t      get_free_pages_count(void) const;
 
+    /**
+     * @brief 统计所有分配器的空闲块
+     * @param  _hist           _hist[i] 为长度在 [2^i, 2^(i+1)) 页的空闲块数
+     * @param  _orders         _hist 长度
+     * @return size_t          最长的连续空闲页数
+     * @note 页缓存中的页视为已使用
+     */
+    size_t      get_free_blocks(size_t* _hist, size_t _orders) const;
+
     /**
      * @brief 分配一页
      * @return uintptr_t       分配的内存起始地址
+     * @note 优先从当前 CPU 的页缓存中分配
      */
     uintptr_t   alloc_page(void);
 
@@ -132,6 +493,24 @@ public:
      */
     uintptr_t   alloc_pages(size_t _len);
 
+    /**
+     * @brief 从指定的 zone 开始分配多页
+     * @param  _len            页数
+     * @param  _zone           首选的 zone
+     * @return uintptr_t       分配的内存起始地址
+     * @note KERNEL 回退到 DMA32、NORMAL，NORMAL 回退到 DMA32，DMA32 不回退
+     */
+    uintptr_t   alloc_pages_zone(size_t _len, zone_type_t _zone);
+
+    /**
+     * @brief 分配起始地址对齐的连续多页
+     * @param  _len            页数
+     * @param  _align          对齐，单位为 bytes，需要为 2 的幂
+     * @return uintptr_t       分配的内存起始地址
+     * @note 其它区域失败后使用保留的连续内存
+     */
+    uintptr_t   alloc_pages_aligned(size_t _len, size_t _align);
+
     /**
      * @brief 分配以指定地址开始的 _len 页
      * @param  _addr           指定的地址
@@ -144,9 +523,30 @@ public:
     /**
      * @brief 在内核空间申请一页
      * @return uintptr_t       分配的内存起始地址
+     * @note 优先从当前 CPU 的页缓存中分配
      */
     uintptr_t   alloc_page_kernel(void);
 
+    /**
+     * @brief 在内核空间申请一页已清零的内存
+     * @return uintptr_t       分配的内存起始地址
+     * @note 优先使用 refill_zero_pool 预先清零的页，没有时当场清零
+     */
+    uintptr_t   alloc_zeroed_page(void);
+
+    /**
+     * @brief 将预先清零的页补充满
+     * @return size_t          本次清零的页数
+     * @note 在空闲时调用，不应在中断处理中调用
+     */
+    size_t      refill_zero_pool(void);
+
+    /**
+     * @brief 获取预先清零的页数
+     * @return size_t          页数
+     */
+    size_t      get_zero_pool_count(void) const;
+
     /**
      * @brief 在内核空间分配 _len 页
      * @param  _len            页数
@@ -166,15 +566,117 @@ public:
     /**
      * @brief 回收一页
      * @param  _addr           要回收的地址
+     * @note 放入当前 CPU 页缓存的热端，下一次分配时优先使用
      */
     void        free_page(uintptr_t _addr);
 
+    /**
+     * @brief 回收一页，内容已不在 cache 中
+     * @param  _addr           要回收的地址
+     * @note 放入当前 CPU 页缓存的冷端，最先被归还给分配器
+     */
+    void        free_page_cold(uintptr_t _addr);
+
+    /**
+     * @brief 将当前 CPU 页缓存中的页全部归还给分配器
+     */
+    void        drain_pcp(void);
+
+    /**
+     * @brief 获取所有 CPU 页缓存的统计信息
+     * @return pcp_stat_t      统计信息之和
+     */
+    pcp_stat_t  get_pcp_stat(void) const;
+
     /**
      * @brief 回收多页
      * @param  _addr           要回收的地址
      * @param  _len            页数
      */
     void        free_pages(uintptr_t _addr, size_t _len);
+
+    /**
+     * @brief 获取 zone 的空闲页数
+     * @param  _zone           zone
+     * @return size_t          空闲页数，不包括页缓存
+     */
+    size_t      get_zone_free_count(zone_type_t _zone) const;
+
+    /**
+     * @brief 注册回收函数
+     * @param  _shrinker       回收函数
+     * @return true            成功
+     * @return false           已满
+     */
+    bool        register_shrinker(shrinker_t _shrinker);
+
+    /**
+     * @brief 回收内存
+     * 归还当前 CPU 的页缓存与预先清零的页，然后依次调用回收函数
+     * @param  _pages          希望回收的页数
+     * @return size_t          分配器中增加的空闲页数
+     */
+    size_t      reclaim(size_t _pages);
+
+    /**
+     * @brief 将低于低水位的 zone 回收到高水位
+     * @return size_t          分配器中增加的空闲页数
+     * @note 在空闲时调用，分配路径上只设置请求，不进行回收
+     */
+    size_t      balance_zones(void);
+
+    /**
+     * @brief 增加一页的引用计数
+     * @param  _addr           页地址，需要是已分配的单页
+     */
+    void        get_page(uintptr_t _addr);
+
+    /**
+     * @brief 减少一页的引用计数，减为 0 时释放
+     * @param  _addr           页地址，需要是已分配的单页
+     * @return true            页已被释放
+     * @return false           仍有其它引用
+     */
+    bool        put_page(uintptr_t _addr);
+
+    /**
+     * @brief 页帧号转换为页描述符
+     * @param  _pfn            页帧号
+     * @return page_t*         页描述符，超出范围返回 nullptr
+     */
+    page_t*     pfn_to_page(size_t _pfn) const {
+        if (_pfn - pages_base >= pages_count) {
+            return nullptr;
+        }
+        return &pages[_pfn - pages_base];
+    }
+
+    /**
+     * @brief 页描述符转换为页帧号
+     * @param  _page           页描述符
+     * @return size_t          页帧号
+     */
+    size_t      page_to_pfn(const page_t* _page) const {
+        return pages_base + (size_t)(_page - pages);
+    }
+
+    /**
+     * @brief 物理地址转换为页描述符
+     * @param  _addr           物理地址
+     * @return page_t*         所在页的描述符，超出范围返回 nullptr
+     */
+    page_t*     addr_to_page(uintptr_t _addr) const {
+        return pfn_to_page(_addr >> COMMON::PAGE_SHIFT);
+    }
+
+    /**
+     * @brief 页描述符转换为物理地址
+     * @param  _page           页描述符
+     * @return uintptr_t       页的起始地址
+     */
+    uintptr_t   page_to_addr(const page_t* _page) const {
+        return (uintptr_t)page_to_pfn(_page) << COMMON::PAGE_SHIFT;
+    }
 };
 
 #endif /* SIMPLEKERNEL_PMM_H */
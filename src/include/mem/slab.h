@@ -26,9 +26,10 @@
 /**
  * @brief SLAB 分配器
  * 只使用了 ALLOCATOR 的部分变量/函数
- * @note 针对常用的 size 分别建立含有三个链表对象(full, part, free)的数组
+ * @note 针对常用的 size 分别建立含有两个链表对象(part, free)的数组
  * 需要分配时在对应 size 数组中寻找一个合适的 chunk
- * 查找方法 首先查 part，再查 free，再没有就申请新的空间，再在 free 中查
+ * 查找方法 首先查 part，再查 free，再没有就申请新的空间
+ * 释放时只与地址相邻的块合并，空闲的整段内存超过水位时才归还
  */
 class SLAB : ALLOCATOR {
 private:
@@ -43,12 +44,16 @@ private:
         // chunk_t 结构的物理地址
         uintptr_t                        addr;
         // 长度，不包括自身大小 单位为 byte
-        // 记录的是实际使用的长度
-        // 按照 8byte 对齐
+        // 已分配的块记录的是实际使用的长度，按照 8byte 对齐
+        // 空闲的块记录的是到下一个块为止的长度
         size_t                           len;
-        /// 双向循环链表指针
+        /// 双向循环链表指针，已分配的块不在链表中，均为 nullptr
         chunk_t*                         prev;
         chunk_t*                         next;
+        /// 地址相邻的前一个块，是所在内存段的第一块时为 nullptr
+        chunk_t*                         phys_prev;
+        /// 地址相邻的后一个块，是所在内存段的最后一块时为 nullptr
+        chunk_t*                         phys_next;
 
         /**
          * @brief 构造函数只会在 SLAB 初始化时调用，且只用于构造头节点
@@ -78,6 +83,18 @@ private:
          * @return chunk_t&        chunk 对象
          */
         chunk_t& operator[](size_t _idx) const;
+
+        /**
+         * @brief 从所在链表中删除
+         */
+        void     unlink(void);
+
+        /**
+         * @brief 是否空闲
+         * @return true            在 part 或 free 链表中
+         * @return false           已分配
+         */
+        bool     is_free(void) const;
     };
 
     /**
@@ -86,65 +103,70 @@ private:
      */
     class slab_cache_t {
     private:
-        /**
-         * @brief 移动节点
-         * @param  _list           目标链表
-         * @param  _node           要移动的节点
-         */
-        void     move(chunk_t& _list, chunk_t* _node);
+        /// free 链表中的页数超过此值时归还给 PMM
+        static constexpr const size_t TRIM_HIGH = 16;
+        /// 归还到此值为止
+        static constexpr const size_t TRIM_LOW  = TRIM_HIGH / 2;
 
         /**
-         * @brief 申请物理内存，返回申请到的地址起点，已经初始化过，且加入 free
-         * 链表
+         * @brief 申请物理内存，返回申请到的地址起点，已经初始化过，不在链表中
          * @param  _len            要申请的长度
          * @return chunk_t*        申请到的 chunk
          */
         chunk_t* alloc_pmm(size_t _len);
 
         /**
-         * @brief 释放内存
+         * @brief 将一整段内存归还给 PMM
+         * @param  _node           要归还的节点，需要已经不在链表中
          */
-        void     free_pmm(void);
+        void     free_pmm(chunk_t* _node);
 
         /**
          * @brief 分割一个节点
-         * @param  _node           要分割的节点
+         * @param  _node           要分割的节点，需要已经不在链表中
          * @param  _len            要保留的长度
-         * @note 如果剩余部分符合要求，新建节点并加入 part 链表
+         * @note 如果剩余部分能容纳一个节点，新建节点并加入 part 链表
          * 同时将 _node->len 设置为 _len
          */
         void     split(chunk_t* _node, size_t _len);
 
         /**
-         * @brief 合并 part 中地址连续的链表项，如果有可回收的回调用 free_pmm
-         * 进行回收
+         * @brief 与地址相邻的空闲块合并
+         * @param  _node           刚释放的节点，不在链表中
+         * @return chunk_t*        合并后的节点，不在链表中
+         * @note 只检查前后两个相邻块，O(1)
          */
-        void     merge(void);
+        chunk_t* merge(chunk_t* _node);
 
         /**
          * @brief 在 _which 链表中查找长度符合的
          * @param  _which          要查找的链表
          * @param  _len            需要的长度
-         * @param  _alloc          如果未找到是否分配
          * @return chunk_t*        未找到返回 nullptr
          */
-        chunk_t* find(chunk_t& _which, size_t _len, bool _alloc);
+        chunk_t* find(chunk_t& _which, size_t _len);
+
+        /**
+         * @brief 归还 free 链表中的内存，直到不超过 _pages 页
+         * @param  _pages          保留的页数
+         * @return size_t          归还的页数
+         */
+        size_t   trim(size_t _pages);
 
     protected:
 
     public:
         // 当前 cache 的长度，单位为 byte
         size_t   len;
-        // 这三个作为头节点使用，不会实际使用
-        // full/part/free 是相对于 pmm
+        // 这两个作为头节点使用，不会实际使用
+        // part/free 是相对于 pmm
         // 分配的一个或多个连续的页而言的
-        // 已经分配的 len 长度的内存，当然 len 不一定全部使用，真实使用的长度由
-        // chunk 记录
-        chunk_t  full;
-        // 申请的内存使用了一部分
+        // 申请的内存使用了一部分，链表中是其中的空闲块
         chunk_t  part;
         // 一整段申请的内存都没有使用
         chunk_t  free;
+        /// free 链表中的页数
+        size_t   free_pages;
         /// 管理的是否为内核地址
         bool     is_kernel_space;
 
@@ -152,18 +174,21 @@ private:
         chunk_t* find(size_t _len);
 
         /**
-         * @brief 释放一个 full 的链表项
+         * @brief 释放一个已分配的节点
          * @param  _node           要释放的节点
+         * @note 与相邻的空闲块合并，整段空闲时加入 free 链表，
+         * 超过 TRIM_HIGH 页时才归还给 PMM
          */
         void     remove(chunk_t* _node);
 
+        /**
+         * @brief 归还 free 链表中所有的内存
+         * @return size_t          归还的页数
+         */
+        size_t   shrink(void);
+
         friend std::ostream&
         operator<<(std::ostream& _out, SLAB::slab_cache_t& _cache) {
-            printf("_cache.full.size(): 0x%X\n", _cache.full.size());
-            for (size_t i = 0; i < _cache.full.size(); i++) {
-                printf("full 0x%X addr: 0x%X, len: 0x%X\n", i,
-                       _cache.full[i].addr, _cache.full[i].len);
-            }
             printf("_cache.part.size(): 0x%X\n", _cache.part.size());
             for (size_t i = 0; i < _cache.part.size(); i++) {
                 printf("part 0x%X addr: 0x%X, len: 0x%X\n", i,
@@ -179,7 +204,7 @@ private:
     };
 
     /// chunk 大小
-    /// @note 32bit: 0x10，64bit: 0x20
+    /// @note 32bit: 0x18，64bit: 0x30
     static constexpr const size_t CHUNK_SIZE = sizeof(chunk_t);
 
     /**
@@ -246,6 +271,12 @@ public:
      */
     void      free(uintptr_t _addr, size_t) override;
 
+    /**
+     * @brief 归还所有空闲的整段内存
+     * @return size_t          归还的页数
+     */
+    size_t    shrink(void);
+
     // 暂时不支持
     size_t    get_used_count(void) const override;
     size_t    get_free_count(void) const override;
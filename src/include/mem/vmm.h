@@ -39,6 +39,9 @@ static constexpr const size_t VMM_KERNEL_SPACE_SIZE = COMMON::KERNEL_SPACE_SIZE;
 static constexpr const size_t VMM_KERNEL_SPACE_PAGES
   = VMM_KERNEL_SPACE_SIZE / COMMON::PAGE_SIZE;
 
+/// 批量修改页表后，超过这个页数时刷新全部 TLB，否则逐页刷新
+static constexpr const size_t VMM_FLUSH_PAGES_MAX = 32;
+
 #if defined(__i386__)
 /// P = 1 表示有效； P = 0 表示无效。
 static constexpr const uint8_t VMM_PAGE_VALID      = 1 << 0;
@@ -49,8 +52,10 @@ static constexpr const uint8_t VMM_PAGE_EXECUTABLE = 0;
 /// U/S-- 位 2 是用户 / 超级用户 (User/Supervisor) 标志。
 /// 如果为 1 那么运行在任何特权级上的程序都可以访问该页面。
 static constexpr const uint8_t VMM_PAGE_USER       = 1 << 2;
-/// 内核虚拟地址相对物理地址的偏移
-static constexpr const size_t  KERNEL_OFFSET       = 0x0;
+/// 直接映射区的虚拟地址相对物理地址的偏移
+static constexpr const size_t  KERNEL_OFFSET       = 0xC0000000;
+/// 直接映射区的大小，更高的物理内存不会被直接映射
+static constexpr const size_t  VMM_DIRECT_MAP_SIZE = 0x38000000;
 /// PTE 属性位数
 static constexpr const size_t  VMM_PTE_PROP_BITS   = 12;
 /// PTE 页内偏移位数
@@ -61,6 +66,13 @@ static constexpr const size_t  VMM_VPN_BITS        = 10;
 static constexpr const size_t  VMM_VPN_BITS_MASK   = 0x3FF;
 /// i386 使用了两级页表
 static constexpr const size_t  VMM_PT_LEVEL        = 2;
+/// PS 位，页目录项直接映射 4MB 大页，需要开启 CR4.PSE
+static constexpr const uint8_t VMM_PAGE_HUGE       = 1 << 7;
+/// 可以映射大页的最高级页表
+static constexpr const size_t  VMM_HUGE_LEVEL      = 1;
+
+/// G 位，全局页，开启 CR4.PGE 后重新加载 CR3 时不会被刷新
+static constexpr const uint16_t VMM_PAGE_GLOBAL = 1 << 8;
 
 #elif defined(__x86_64__)
 /// P = 1 表示有效； P = 0 表示无效。
@@ -72,8 +84,10 @@ static constexpr const uint8_t VMM_PAGE_EXECUTABLE = 0;
 /// U/S-- 位 2 是用户 / 超级用户 (User/Supervisor) 标志。
 /// 如果为 1 那么运行在任何特权级上的程序都可以访问该页面。
 static constexpr const uint8_t VMM_PAGE_USER       = 1 << 2;
-/// 内核虚拟地址相对物理地址的偏移
-static constexpr const size_t  KERNEL_OFFSET       = 0x0;
+/// 直接映射区的虚拟地址相对物理地址的偏移
+static constexpr const size_t  KERNEL_OFFSET       = 0xFFFF888000000000;
+/// 直接映射区的大小，64TB
+static constexpr const size_t  VMM_DIRECT_MAP_SIZE = 0x400000000000;
 /// PTE 属性位数
 static constexpr const size_t  VMM_PTE_PROP_BITS   = 12;
 /// PTE 页内偏移位数
@@ -84,6 +98,15 @@ static constexpr const size_t  VMM_VPN_BITS        = 9;
 static constexpr const size_t  VMM_VPN_BITS_MASK   = 0x1FF;
 /// x86_64 使用了四级页表
 static constexpr const size_t  VMM_PT_LEVEL        = 4;
+/// PS 位，PD/PDPT 项直接映射 2MB/1GB 大页
+static constexpr const uint8_t VMM_PAGE_HUGE       = 1 << 7;
+/// 可以映射大页的最高级页表，1GB 页需要 CPU 支持
+static constexpr const size_t  VMM_HUGE_LEVEL      = 2;
+
+/// G 位，全局页，开启 CR4.PGE 后重新加载 CR3 时不会被刷新
+static constexpr const uint16_t VMM_PAGE_GLOBAL = 1 << 8;
+/// PCID 位数，需要 CPU 支持
+static constexpr const size_t   VMM_PCID_BITS   = 12;
 
 #elif defined(__riscv)
 /// 有效位
@@ -96,14 +119,16 @@ static constexpr const uint8_t VMM_PAGE_WRITABLE   = CPU::pte_t::WRITE;
 static constexpr const uint8_t VMM_PAGE_EXECUTABLE = CPU::pte_t::EXEC;
 /// 用户位
 static constexpr const uint8_t VMM_PAGE_USER       = CPU::pte_t::USER;
-/// 全局位，我们不会使用
+/// 全局位，所有地址空间共享，按 ASID 刷新时不会被刷新
 static constexpr const uint8_t VMM_PAGE_GLOBAL     = CPU::pte_t::GLOBAL;
 /// 已使用位，用于替换算法
 static constexpr const uint8_t VMM_PAGE_ACCESSED   = CPU::pte_t::ACCESSED;
 /// 已修改位，用于替换算法
 static constexpr const uint8_t VMM_PAGE_DIRTY      = CPU::pte_t::DIRTY;
-/// 内核虚拟地址相对物理地址的偏移
-static constexpr const size_t  KERNEL_OFFSET       = 0x0;
+/// 直接映射区的虚拟地址相对物理地址的偏移，sv39 高地址空间的起始
+static constexpr const size_t  KERNEL_OFFSET       = 0xFFFFFFC000000000;
+/// 直接映射区的大小，128GB
+static constexpr const size_t  VMM_DIRECT_MAP_SIZE = 0x2000000000;
 /// PTE 属性位数
 static constexpr const size_t  VMM_PTE_PROP_BITS   = 10;
 /// PTE 页内偏移位数
@@ -114,10 +139,23 @@ static constexpr const size_t  VMM_VPN_BITS        = 9;
 static constexpr const size_t  VMM_VPN_BITS_MASK   = 0x1FF;
 /// riscv64 使用了三级页表
 static constexpr const size_t  VMM_PT_LEVEL        = 3;
+/// 没有单独的大页标志，R/W/X 任意一位不为 0 的非最低级页表项即为大页
+static constexpr const uint8_t VMM_PAGE_HUGE       = 0;
+/// 可以映射大页的最高级页表，2MB/1GB
+static constexpr const size_t  VMM_HUGE_LEVEL      = 2;
 #endif
 
+/// 顶级页表项映射的大小，用户区域不与内核映射共享顶级页表项
+static constexpr const size_t VMM_PGD_ENTRY_SIZE
+  = (size_t)1 << (VMM_PAGE_OFF_BITS + VMM_VPN_BITS * (VMM_PT_LEVEL - 1));
+
+/// 直接映射物理内存使用的属性，所有地址空间相同，设置为全局页
+static constexpr const uint32_t VMM_PAGE_KERNEL
+  = VMM_PAGE_READABLE | VMM_PAGE_WRITABLE | VMM_PAGE_EXECUTABLE
+  | VMM_PAGE_GLOBAL;
+
 /**
- * @brief 虚拟地址到物理地址转换
+ * @brief 直接映射区的虚拟地址到物理地址转换
  * @param  _va             要转换的虚拟地址
  * @return constexpr uintptr_t 转换好的地址
  */
@@ -126,14 +164,26 @@ static constexpr uintptr_t VMM_VA2PA(uintptr_t _va) {
 }
 
 /**
- * @brief 物理地址到虚拟地址转换
+ * @brief 物理地址到直接映射区的虚拟地址转换
  * @param  _pa             要转换的物理地址
  * @return constexpr uintptr_t 转换好的地址
+ * @note 开启分页后所有物理内存都可以通过直接映射区访问
  */
 static constexpr uintptr_t VMM_PA2VA(uintptr_t _pa) {
     return _pa + KERNEL_OFFSET;
 }
 
+/**
+ * @brief 虚拟地址是否位于直接映射区
+ * @param  _va             虚拟地址
+ * @return true            是
+ * @return false           否
+ */
+static constexpr bool VMM_IS_DIRECT(uintptr_t _va) {
+    return (_va >= KERNEL_OFFSET)
+        && (_va - KERNEL_OFFSET < VMM_DIRECT_MAP_SIZE);
+}
+
 /**
  * @brief 虚拟内存抽象
  */
@@ -168,6 +218,50 @@ private:
         return VMM_PAGE_OFF_BITS + (VMM_VPN_BITS * _level);
     }
 
+    /**
+     * @brief 第 _level 级页表项映射的大小
+     * @param  _level          级别
+     * @return constexpr size_t 大小，单位为 bytes
+     */
+    static constexpr size_t PXSIZE(const size_t _level) {
+        return (size_t)1 << PXSHIFT(_level);
+    }
+
+    /**
+     * @brief 有效的页表项是否直接映射物理页
+     * @param  _pte            页表项
+     * @param  _level          页表项所在的级别
+     * @return true            映射物理页
+     * @return false           指向下一级页表
+     */
+    static constexpr bool is_leaf(const pte_t _pte, const size_t _level) {
+#if defined(__riscv)
+        (void)_level;
+        return (_pte
+                & (VMM_PAGE_READABLE | VMM_PAGE_WRITABLE | VMM_PAGE_EXECUTABLE))
+            != 0;
+#else
+        return (_level == 0) || ((_pte & VMM_PAGE_HUGE) != 0);
+#endif
+    }
+
+    /**
+     * @brief 修改页表项后是否需要刷新 TLB
+     * @param  _old            修改前的页表项
+     * @return true            需要
+     * @return false           不需要
+     */
+    static constexpr bool need_flush(const pte_t _old) {
+#if defined(__riscv)
+        // 没有 Svvptc 扩展时，无效的页表项变为有效后也需要 sfence.vma
+        (void)_old;
+        return true;
+#else
+        // x86 不会缓存无效的页表项
+        return (_old & VMM_PAGE_VALID) != 0;
+#endif
+    }
+
     /**
      * @brief 获取 _va 的第 _level 级 VPN
      * @note 例如虚拟地址右移 12+(10 * _level) 位，
@@ -177,15 +271,127 @@ private:
         return (_va >> PXSHIFT(_level)) & VMM_VPN_BITS_MASK;
     }
 
+    /// 实际可以使用的最高大页级别，0 表示不支持大页
+    size_t    huge_level;
+    /// 访问页表时加在物理地址上的偏移，开启分页前为 0，
+    /// 之后通过直接映射区访问
+    uintptr_t pt_offset;
+    /// 正在使用的页表页数，包括页目录
+    size_t    pt_pages;
+
+    /// ASID 位数，0 表示不使用 ASID，每次切换页目录都需要刷新 TLB
+    size_t   asid_bits;
+    /// ASID 的代，ASID 用完后增加，之前分配的 ASID 全部失效
+    uint32_t asid_generation;
+    /// 当前代中下一个可用的 ASID，0 保留给没有 ASID 的页目录
+    size_t   asid_next;
+
+    /**
+     * @brief 确定 ASID 位数，x86_64 需要开启 CR4.PCIDE
+     * @note 页目录的 ASID 保存在其页描述符中，prev 为 ASID，next 为代，
+     * 代与 asid_generation 不同时，在下次切换到它时重新分配
+     */
+    void     init_asid(void);
+
+    /**
+     * @brief 分配页目录
+     * @return pt_t            已经清零的页目录，还没有分配 ASID
+     */
+    pt_t     new_pgd(void);
+
+    /**
+     * @brief 分配一页页表
+     * @return uintptr_t       已经清零的页表的物理地址，失败返回 0
+     * @note 页目录以外的页表在页描述符的 prev 中记录有效页表项数
+     */
+    uintptr_t alloc_table(void);
+
+    /**
+     * @brief 释放一页页表
+     * @param  _pa             页表的物理地址
+     * @note 页表被其它页目录共享时只减少引用
+     */
+    void      free_table(uintptr_t _pa);
+
     /**
-     * @brief 在 _pgd 中查找 _va 对应的页表项
+     * @brief 设置页表项，维护所在页表的有效页表项数
+     * @param  _pgd            页表项所在的页目录
+     * @param  _pte            页表项
+     * @param  _val            新的值
+     */
+    void      set_pte(const pt_t _pgd, pte_t* _pte, pte_t _val);
+
+    /**
+     * @brief 从第 _level 级开始，逐级释放 _va 所在的空页表
+     * @param  _pgd            页目录
+     * @param  _va             刚被取消映射的虚拟地址
+     * @param  _level          被清除的页表项所在的级别
+     * @return size_t          释放的页表数
+     * @note 释放了页表时需要刷新整个地址空间，
+     * 部分架构按地址刷新时不会刷新缓存的中间级页表项
+     */
+    size_t    free_empty(const pt_t _pgd, uintptr_t _va, size_t _level);
+
+    /**
+     * @brief 获取可以访问的页表地址
+     * @param  _pa             页表的物理地址
+     * @return pt_t            页表的虚拟地址
+     */
+    pt_t   pa2pt(uintptr_t _pa) const;
+
+    /**
+     * @brief 在 _pgd 中查找 _va 对应的第 _level 级页表项
      * 如果未找到，_alloc 为真时会进行分配
      * @param  _pgd            要查找的页目录
      * @param  _va             虚拟地址
      * @param  _alloc          是否分配
-     * @return pte_t*          未找到返回 nullptr
+     * @param  _level          要查找的级别，途中遇到大页时，
+     * _alloc 为真会将大页拆分，否则返回大页的页表项，并将 _level 设置为其级别
+     * @return pte_t*          未找到返回 nullptr，
+     * 此时 _level 被设置为无效的页表项所在的级别
+     */
+    pte_t* find(const pt_t _pgd, uintptr_t _va, bool _alloc, size_t& _level);
+
+    /**
+     * @brief 将第 _level 级的大页拆分为下一级的 VMM_PAGES_PRE_PAGE_TABLE 项
+     * @param  _pte            大页的页表项
+     * @param  _level          大页的级别
+     * @return true            成功
+     * @return false           失败
+     * @note 拆分前后的映射相同，不需要刷新 TLB
+     */
+    bool   split(pte_t* _pte, size_t _level);
+
+    /**
+     * @brief 修改 _pgd 中 [_start, _end) 的映射后刷新 TLB
+     * @param  _pgd            修改的页目录，不是当前页目录时使其 ASID 失效
+     * @param  _start          起始虚拟地址
+     * @param  _end            结束虚拟地址
+     * @param  _global         是否修改了全局页
+     * @note 不超过 VMM_FLUSH_PAGES_MAX 页时逐页刷新，
+     * 否则刷新当前地址空间，修改了全局页时刷新全部
+     */
+    void   flush(const pt_t _pgd, uintptr_t _start, uintptr_t _end,
+                 bool _global);
+
+    /**
+     * @brief 复制第 _level 级页表 _src 到 _dst
+     * @param  _dst            目标页表的物理地址，已经清零
+     * @param  _src            源页表的物理地址
+     * @param  _level          页表级别，不是页目录
+     * @return true            成功
+     * @return false           内存不足，已经复制的页表挂在 _dst 中
+     * @note 下级页表被复制，叶子页表项共享
+     */
+    bool   clone_pt(pt_t _dst, const pt_t _src, size_t _level);
+
+    /**
+     * @brief 释放第 _level 级页表及其所有下级页表
+     * @param  _pt             页表的物理地址
+     * @param  _level          页表级别
+     * @note 不释放叶子页表项映射的物理页，共享的页表只减少引用
      */
-    pte_t* find(const pt_t _pgd, uintptr_t _va, bool _alloc);
+    void   free_pt(pt_t _pt, size_t _level);
 
 protected:
 
@@ -212,34 +418,127 @@ public:
     /**
      * @brief 设置当前页目录
      * @param  _pgd            要设置的页目录
+     * @note _pgd 的 ASID 仍然有效时，切换时不需要刷新 TLB
      */
     void        set_pgd(const pt_t _pgd);
 
+    /**
+     * @brief 获取页目录的 ASID
+     * @param  _pgd            页目录
+     * @return size_t          ASID，0 表示没有分配或已经失效
+     */
+    size_t      get_asid(const pt_t _pgd) const;
+
+    /**
+     * @brief 获取正在使用的页表页数
+     * @return size_t          页表页数，包括所有页目录
+     */
+    size_t      get_pt_pages(void) const;
+
+    /**
+     * @brief 获取可以使用的最高大页级别
+     * @return size_t          级别，0 表示不支持大页
+     * @note 第 n 级页表项映射 1 << (VMM_PAGE_OFF_BITS + VMM_VPN_BITS * n) bytes
+     */
+    size_t      get_huge_level(void) const;
+
     /**
      * @brief 映射物理地址到虚拟地址
      * @param  _pgd            要使用的页目录
      * @param  _va             要映射的虚拟地址
      * @param  _pa             物理地址
      * @param  _flag           属性
+     * @param  _level          在第几级页表映射，大于 0 时映射大页，
+     * _va 与 _pa 需要按照大页大小对齐
+     */
+    void mmap(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, uint32_t _flag,
+              size_t _level = 0);
+
+    /**
+     * @brief 映射一段连续的物理地址，对齐且长度足够时使用大页
+     * @param  _pgd            要使用的页目录
+     * @param  _va             要映射的虚拟地址
+     * @param  _pa             物理地址
+     * @param  _len            长度，单位为 bytes，需要按页对齐
+     * @param  _flag           属性
+     * @note 同一页表中的连续页表项只查找一次，结束后统一刷新 TLB
      */
-    void mmap(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, uint32_t _flag);
+    void mmap_range(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, size_t _len,
+                    uint32_t _flag);
+
+    /**
+     * @brief 将连续的 _n 页虚拟地址映射到各自的物理页
+     * @param  _pgd            要使用的页目录
+     * @param  _va             起始虚拟地址，需要按页对齐
+     * @param  _pas            每一页的物理地址，为 0 的页跳过
+     * @param  _n              页数
+     * @param  _flag           属性
+     * @note 同一页表中的页表项只查找一次，结束后统一刷新 TLB
+     */
+    void mmap_pages(const pt_t _pgd, uintptr_t _va, const uintptr_t* _pas,
+                    size_t _n, uint32_t _flag);
 
     /**
      * @brief 取消映射
      * @param  _pgd            要操作的页目录
      * @param  _va             要取消映射的虚拟地址
+     * @note 如果 _va 位于大页中，会先拆分大页，只取消 _va 所在的页，
+     * 变空的页表会被释放
      */
     void unmmap(const pt_t _pgd, uintptr_t _va);
 
+    /**
+     * @brief 取消一段虚拟地址的映射
+     * @param  _pgd            要操作的页目录
+     * @param  _va             要取消映射的虚拟地址
+     * @param  _len            长度，单位为 bytes，需要按页对齐
+     * @note 未映射的部分会被跳过，部分位于范围内的大页会被拆分，
+     * 变空的页表会被释放，结束后统一刷新 TLB
+     */
+    void unmap_range(const pt_t _pgd, uintptr_t _va, size_t _len);
+
     /**
      * @brief 获取映射的物理地址
      * @param  _pgd            页目录
      * @param  _va             虚拟地址
      * @param  _pa             如果已经映射，保存映射的物理地址，否则为 nullptr
+     * @param  _flag           不为空且已经映射时，保存页表项的属性
      * @return true            已映射
      * @return false           未映射
      */
-    bool get_mmap(const pt_t _pgd, uintptr_t _va, const void* _pa);
+    bool get_mmap(const pt_t _pgd, uintptr_t _va, const void* _pa,
+                  uint32_t* _flag = nullptr);
+
+    /**
+     * @brief 复制地址空间，用于创建进程
+     * @param  _pgd            要复制的页目录
+     * @return pt_t            新的页目录，失败返回 nullptr
+     * @note 只复制页目录，顶级页表项指向相同的下级页表，内核映射在两边共享，
+     * 用户区域需要由所有者调用 cow_range 复制页表并设置写时复制
+     */
+    pt_t clone(const pt_t _pgd);
+
+    /**
+     * @brief 将 clone 得到的 _dst 与 _src 中 [_va, _va+_len) 的私有页写时复制
+     * @param  _src            被复制的页目录
+     * @param  _dst            clone(_src) 返回的页目录，还没有使用过
+     * @param  _va             起始虚拟地址，需要按页对齐
+     * @param  _len            长度，单位为 bytes，需要按页对齐
+     * @return true            成功
+     * @return false           内存不足，没有修改引用计数，_dst 可以直接释放
+     * @note 范围所在的顶级页表项在 _dst 中复制为私有的页表，
+     * 有页描述符且已分配的 4KB 物理页增加引用计数，
+     * 可写的在两边都设置为只读，写入时由缺页处理复制，大页直接共享
+     */
+    bool cow_range(const pt_t _src, const pt_t _dst, uintptr_t _va,
+                   size_t _len);
+
+    /**
+     * @brief 释放页目录及其所有页表
+     * @param  _pgd            要释放的页目录，不能是当前页目录
+     * @note 映射的物理页由其所有者释放
+     */
+    void free_pgd(pt_t _pgd);
 };
 
 #endif /* SIMPLEKERNEL_VMM_H */
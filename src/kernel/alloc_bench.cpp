@@ -0,0 +1,160 @@
+/**
+ * @file alloc_bench.cpp
+ * @brief 页分配器基准测试实现
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#include "alloc_bench.h"
+#include "cassert"
+#include "cpu.hpp"
+#include "cstdio"
+
+/**
+ * @brief 64 位无符号除法
+ * @param  _n              被除数
+ * @param  _d              除数
+ * @return uint64_t        商
+ * @note 32 位下没有 libgcc 提供的 __udivdi3，逐位计算
+ */
+static uint64_t div64(uint64_t _n, uint64_t _d) {
+    uint64_t q = 0;
+    uint64_t r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((_n >> i) & 1);
+        if (r >= _d) {
+            r -= _d;
+            q |= (uint64_t)1 << i;
+        }
+    }
+    return q;
+}
+
+uint64_t ALLOC_BENCH::rand(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+size_t ALLOC_BENCH::rand_len(void) {
+    size_t r = (size_t)rand() % 100;
+    if (r < 50) {
+        return 1;
+    }
+    else if (r < 80) {
+        return 2 + (size_t)rand() % 7;
+    }
+    else if (r < 95) {
+        return 9 + (size_t)rand() % 56;
+    }
+    else {
+        return 65 + (size_t)rand() % 448;
+    }
+}
+
+uint64_t ALLOC_BENCH::to_ns(uint64_t _ticks, size_t _ops) const {
+    if (_ops == 0) {
+        return 0;
+    }
+    // 先计算每次操作的 1/1000 计数，避免溢出与精度损失
+    return div64(div64(_ticks * 1000, _ops) * 1000000, freq);
+}
+
+ALLOC_BENCH::ALLOC_BENCH(const char* _name, ALLOCATOR* _allocator,
+                         live_t* _live, size_t _live_max, uint64_t _freq,
+                         uint64_t _seed)
+    : name(_name),
+      allocator(_allocator),
+      live(_live),
+      live_max(_live_max),
+      live_count(0),
+      freq(_freq),
+      state(_seed) {
+    assert(_seed != 0);
+    return;
+}
+
+ALLOC_BENCH::~ALLOC_BENCH(void) {
+    free_all();
+    return;
+}
+
+ALLOC_BENCH::result_t ALLOC_BENCH::run(size_t _ops, size_t _interval) {
+    result_t ret       = {};
+    uint64_t alloc_sum = 0;
+    uint64_t free_sum  = 0;
+    ret.largest_min    = ~(size_t)0;
+    for (size_t i = 1; i <= _ops; i++) {
+        // 略偏向分配，使内存使用量逐渐增加
+        bool do_alloc
+          = (live_count == 0)
+         || ((live_count < live_max) && ((size_t)rand() % 100 < 55));
+        if (do_alloc) {
+            size_t    len   = rand_len();
+            uint64_t  start = CPU::READ_TIME();
+            uintptr_t addr  = allocator->alloc(len);
+            alloc_sum      += CPU::READ_TIME() - start;
+            if (addr == 0) {
+                ret.fails++;
+            }
+            else {
+                live[live_count].addr = addr;
+                live[live_count].len  = len;
+                live_count++;
+                ret.allocs++;
+            }
+        }
+        else {
+            // 随机释放一个，用最后一项填补空位
+            size_t   idx   = (size_t)rand() % live_count;
+            live_t   curr  = live[idx];
+            live[idx]      = live[live_count - 1];
+            live_count--;
+            uint64_t start = CPU::READ_TIME();
+            allocator->free(curr.addr, curr.len);
+            free_sum += CPU::READ_TIME() - start;
+            ret.frees++;
+        }
+        if ((i % _interval == 0) || (i == _ops)) {
+            ret.largest = allocator->get_free_blocks(ret.hist, ORDERS);
+            if (ret.largest < ret.largest_min) {
+                ret.largest_min = ret.largest;
+            }
+            info("%s: %lld ops, %lld live, %lld free pages, largest free "
+                 "run %lld pages.\n",
+                 name, (long long)i, (long long)live_count,
+                 (long long)allocator->get_free_count(),
+                 (long long)ret.largest);
+        }
+    }
+    ret.alloc_ns = to_ns(alloc_sum, ret.allocs + ret.fails);
+    ret.free_ns  = to_ns(free_sum, ret.frees);
+    info("%s: alloc %lld ns/op (%lld failed), free %lld ns/op.\n", name,
+         (long long)ret.alloc_ns, (long long)ret.fails,
+         (long long)ret.free_ns);
+    // 空闲块直方图
+    for (size_t i = 0; i < ORDERS; i++) {
+        if (ret.hist[i] != 0) {
+            printf("    [2^%lld, 2^%lld) pages: %lld\n", (long long)i,
+                   (long long)i + 1, (long long)ret.hist[i]);
+        }
+    }
+    return ret;
+}
+
+void ALLOC_BENCH::free_all(void) {
+    while (live_count > 0) {
+        live_count--;
+        allocator->free(live[live_count].addr, live[live_count].len);
+    }
+    return;
+}
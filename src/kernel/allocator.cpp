@@ -15,6 +15,7 @@
  */
 
 #include "allocator.h"
+#include "common.h"
 #include "cstddef"
 #include "cstdint"
 
@@ -32,3 +33,29 @@ ALLOCATOR::ALLOCATOR(const char* _name, uintptr_t _addr, size_t _len) {
 ALLOCATOR::~ALLOCATOR(void) {
     return;
 }
+
+uintptr_t ALLOCATOR::alloc_aligned(size_t _len, size_t _align) {
+    size_t extra = _align / COMMON::PAGE_SIZE - 1;
+    // 多分配 extra 页，其中一定有对齐的地址
+    uintptr_t addr = alloc(_len + extra);
+    if (addr == 0) {
+        return 0;
+    }
+    uintptr_t ret = COMMON::ALIGN(addr, _align);
+    // 归还首尾多余的部分
+    if (ret > addr) {
+        free(addr, (ret - addr) / COMMON::PAGE_SIZE);
+    }
+    size_t tail = extra - (ret - addr) / COMMON::PAGE_SIZE;
+    if (tail > 0) {
+        free(ret + _len * COMMON::PAGE_SIZE, tail);
+    }
+    return ret;
+}
+
+size_t ALLOCATOR::get_free_blocks(size_t* _hist, size_t _orders) const {
+    for (size_t i = 0; i < _orders; i++) {
+        _hist[i] = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+
+/**
+ * @file buddy.cpp
+ * @brief buddy 内存分配器实现
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#include "buddy.h"
+#include "cassert"
+#include "common.h"
+#include "cstdint"
+#include "cstdio"
+#include "cstring"
+
+size_t BUDDY::get_order(size_t _len) {
+    size_t order = 0;
+    while (((size_t)1 << order) < _len) {
+        order++;
+    }
+    return order;
+}
+
+void BUDDY::push(size_t _idx, size_t _order) {
+    // 插入到链表头
+    nodes[_idx].prev = NONE;
+    nodes[_idx].next = free_list[_order];
+    if (free_list[_order] != NONE) {
+        nodes[free_list[_order]].prev = _idx;
+    }
+    free_list[_order] = _idx;
+    // 标记为空闲块首页
+    orders[_idx]      = FREE | _order;
+    free_blocks[_order]++;
+    return;
+}
+
+void BUDDY::remove(size_t _idx) {
+    size_t order = orders[_idx] & ORDER_MASK;
+    // 从链表中删除
+    if (nodes[_idx].prev != NONE) {
+        nodes[nodes[_idx].prev].next = nodes[_idx].next;
+    }
+    else {
+        free_list[order] = nodes[_idx].next;
+    }
+    if (nodes[_idx].next != NONE) {
+        nodes[nodes[_idx].next].prev = nodes[_idx].prev;
+    }
+    // 清除标记
+    orders[_idx] = 0;
+    free_blocks[order]--;
+    return;
+}
+
+void BUDDY::merge(size_t _idx, size_t _order) {
+    while (_order < ORDER_MAX) {
+        // 伙伴块的索引只有第 _order 位不同
+        size_t buddy = _idx ^ ((size_t)1 << _order);
+        // 伙伴块超出范围，或不是同阶的空闲块，无法合并
+        if ((buddy + ((size_t)1 << _order) > allocator_length)
+            || (orders[buddy] != (FREE | _order))) {
+            break;
+        }
+        // 合并
+        remove(buddy);
+        if (buddy < _idx) {
+            _idx = buddy;
+        }
+        _order++;
+    }
+    push(_idx, _order);
+    return;
+}
+
+void BUDDY::free_range(size_t _idx, size_t _len) {
+    size_t end = _idx + _len;
+    while (_idx < end) {
+        // 找到 _idx 处对齐且不超过 end 的最大块
+        size_t order = 0;
+        while ((order < ORDER_MAX) && ((_idx & ((size_t)1 << order)) == 0)
+               && (_idx + ((size_t)2 << order) <= end)) {
+            order++;
+        }
+        merge(_idx, order);
+        _idx += (size_t)1 << order;
+    }
+    return;
+}
+
+size_t BUDDY::find_block(size_t _idx) const {
+    // 包含 _idx 的 order 阶块，首页一定是 _idx 的低 order 位清零
+    for (size_t order = 0; order <= ORDER_MAX; order++) {
+        size_t head = _idx & ~(((size_t)1 << order) - 1);
+        if (orders[head] == (FREE | order)) {
+            return head;
+        }
+    }
+    return NONE;
+}
+
+size_t BUDDY::get_meta_size(size_t _len) {
+    return _len * (sizeof(node_t) + sizeof(uint8_t));
+}
+
+BUDDY::BUDDY(const char* _name, uintptr_t _addr, size_t _len, void* _meta)
+    : ALLOCATOR(_name, _addr, _len) {
+    // 链表节点在前，阶数在后
+    nodes  = (node_t*)_meta;
+    orders = (uint8_t*)(nodes + allocator_length);
+    bzero(orders, allocator_length * sizeof(uint8_t));
+    for (size_t i = 0; i <= ORDER_MAX; i++) {
+        free_list[i]   = NONE;
+        free_blocks[i] = 0;
+    }
+    // 初始状态下所有页都是空闲的
+    free_range(0, allocator_length);
+    info("%s: 0x%p(0x%X pages) init.\n", name, allocator_start_addr,
+         allocator_length);
+    return;
+}
+
+BUDDY::~BUDDY(void) {
+    info("%s finit.\n", name);
+    return;
+}
+
+uintptr_t BUDDY::alloc(size_t _len) {
+    uintptr_t res_addr = 0;
+    size_t    order    = get_order(_len);
+    // 超过最大阶数
+    if ((_len == 0) || (order > ORDER_MAX)) {
+        return res_addr;
+    }
+    // 找到有空闲块的最小阶
+    size_t curr = order;
+    while ((curr <= ORDER_MAX) && (free_list[curr] == NONE)) {
+        curr++;
+    }
+    // 未找到
+    if (curr > ORDER_MAX) {
+        // err("NO ENOUGH MEM.\n");
+        return res_addr;
+    }
+    size_t idx = free_list[curr];
+    remove(idx);
+    // 对半分割，后一半放回对应的链表
+    while (curr > order) {
+        curr--;
+        push(idx + ((size_t)1 << curr), curr);
+    }
+    // 归还多余的尾部
+    if (_len < ((size_t)1 << order)) {
+        free_range(idx + _len, ((size_t)1 << order) - _len);
+    }
+    // 计算实际地址
+    res_addr              = allocator_start_addr + (COMMON::PAGE_SIZE * idx);
+    // 更新统计信息
+    allocator_free_count -= _len;
+    allocator_used_count += _len;
+    return res_addr;
+}
+
+uintptr_t BUDDY::alloc_aligned(size_t _len, size_t _align) {
+    size_t align_pages = _align / COMMON::PAGE_SIZE;
+    // 起始地址未对齐，使用默认实现
+    if ((allocator_start_addr & (_align - 1)) != 0) {
+        return ALLOCATOR::alloc_aligned(_len, _align);
+    }
+    // 2^order >= _len >= align_pages 时，块本身已经对齐
+    if (_len >= align_pages) {
+        return alloc(_len);
+    }
+    // 按 _align 大小分配后归还尾部
+    uintptr_t ret = alloc(align_pages);
+    if (ret != 0) {
+        free(ret + _len * COMMON::PAGE_SIZE, align_pages - _len);
+    }
+    return ret;
+}
+
+bool BUDDY::alloc(uintptr_t _addr, size_t _len) {
+    // _addr 不在管理范围内
+    if ((_addr < allocator_start_addr)
+        || (_addr
+            >= allocator_start_addr + allocator_length * COMMON::PAGE_SIZE)) {
+        return false;
+    }
+    // 计算 _addr 对应的索引
+    size_t idx = (_addr - allocator_start_addr) / COMMON::PAGE_SIZE;
+    size_t end = idx + _len;
+    if (end > allocator_length) {
+        return false;
+    }
+    // 确认范围内全部空闲
+    size_t curr = idx;
+    while (curr < end) {
+        size_t head = find_block(curr);
+        // 如果在范围内有已经分配的内存，返回 false
+        if (head == NONE) {
+            return false;
+        }
+        curr = head + ((size_t)1 << (orders[head] & ORDER_MASK));
+    }
+    // 逐块取出，范围外的部分放回
+    curr = idx;
+    while (curr < end) {
+        size_t head      = find_block(curr);
+        size_t block_end = head + ((size_t)1 << (orders[head] & ORDER_MASK));
+        remove(head);
+        if (head < curr) {
+            free_range(head, curr - head);
+        }
+        if (block_end > end) {
+            free_range(end, block_end - end);
+            block_end = end;
+        }
+        curr = block_end;
+    }
+    // 更新统计信息
+    allocator_free_count -= _len;
+    allocator_used_count += _len;
+    return true;
+}
+
+void BUDDY::free(uintptr_t _addr, size_t _len) {
+    // _addr 不在管理范围内
+    if ((_addr < allocator_start_addr)
+        || (_addr
+            >= allocator_start_addr + allocator_length * COMMON::PAGE_SIZE)) {
+        return;
+    }
+    // 计算 _addr 对应的索引
+    size_t idx = (_addr - allocator_start_addr) / COMMON::PAGE_SIZE;
+    assert(idx + _len <= allocator_length);
+    free_range(idx, _len);
+    // 更新统计信息
+    allocator_free_count += _len;
+    allocator_used_count -= _len;
+    return;
+}
+
+size_t BUDDY::get_used_count(void) const {
+    return allocator_used_count;
+}
+
+size_t BUDDY::get_free_count(void) const {
+    return allocator_free_count;
+}
+
+size_t BUDDY::get_free_blocks(size_t* _hist, size_t _orders) const {
+    for (size_t i = 0; i < _orders; i++) {
+        _hist[i] = 0;
+    }
+    for (size_t i = 0; i <= ORDER_MAX; i++) {
+        _hist[i < _orders ? i : _orders - 1] += free_blocks[i];
+    }
+    // 按地址遍历，跳过空闲块后的下一页一定是块首页或已分配的页
+    size_t ret = 0;
+    size_t run = 0;
+    size_t idx = 0;
+    while (idx < allocator_length) {
+        if ((orders[idx] & FREE) != 0) {
+            run += (size_t)1 << (orders[idx] & ORDER_MASK);
+            idx += (size_t)1 << (orders[idx] & ORDER_MASK);
+        }
+        else {
+            run = 0;
+            idx++;
+        }
+        if (run > ret) {
+            ret = run;
+        }
+    }
+    return ret;
+}
@@ -20,43 +20,177 @@
 #include "cstdio"
 #include "cstring"
 
-void FIRSTFIT::set(size_t _idx) {
-    map[_idx >> SHIFT] |= (uintptr_t)1 << (_idx & MASK);
+uintptr_t FIRSTFIT::mask(size_t _bit, size_t _len) {
+    // 整个字
+    if (_len >= WORD_BITS) {
+        return ~(uintptr_t)0;
+    }
+    return (((uintptr_t)1 << _len) - 1) << _bit;
+}
+
+void FIRSTFIT::update(size_t _word) {
+    if (map[_word] == ~(uintptr_t)0) {
+        summary[_word >> SHIFT] |= (uintptr_t)1 << (_word & MASK);
+    }
+    else {
+        summary[_word >> SHIFT] &= ~((uintptr_t)1 << (_word & MASK));
+    }
+    return;
+}
+
+void FIRSTFIT::set_range(size_t _idx, size_t _len) {
+    size_t end = _idx + _len;
+    while (_idx < end) {
+        // 当前字内需要处理的位数
+        size_t bit = _idx & MASK;
+        size_t len = WORD_BITS - bit;
+        if (len > end - _idx) {
+            len = end - _idx;
+        }
+        map[_idx >> SHIFT] |= mask(bit, len);
+        update(_idx >> SHIFT);
+        _idx += len;
+    }
     return;
 }
 
-void FIRSTFIT::clr(size_t _idx) {
-    map[_idx >> SHIFT] &= ~((uintptr_t)1 << (_idx & MASK));
+void FIRSTFIT::clr_range(size_t _idx, size_t _len) {
+    size_t end = _idx + _len;
+    while (_idx < end) {
+        // 当前字内需要处理的位数
+        size_t bit = _idx & MASK;
+        size_t len = WORD_BITS - bit;
+        if (len > end - _idx) {
+            len = end - _idx;
+        }
+        map[_idx >> SHIFT] &= ~mask(bit, len);
+        update(_idx >> SHIFT);
+        _idx += len;
+    }
     return;
 }
 
-bool FIRSTFIT::test(size_t _idx) const {
-    return map[_idx >> SHIFT] & ((uintptr_t)1 << (_idx & MASK));
+bool FIRSTFIT::test_range(size_t _idx, size_t _len) const {
+    size_t end = _idx + _len;
+    while (_idx < end) {
+        // 当前字内需要处理的位数
+        size_t bit = _idx & MASK;
+        size_t len = WORD_BITS - bit;
+        if (len > end - _idx) {
+            len = end - _idx;
+        }
+        if ((map[_idx >> SHIFT] & mask(bit, len)) != 0) {
+            return true;
+        }
+        _idx += len;
+    }
+    return false;
 }
 
 size_t FIRSTFIT::find_len(size_t _len, bool _val) const {
+    // 当前连续的位数
     size_t count = 0;
+    // 当前连续段的起点
     size_t idx   = 0;
-    // 遍历位图
-    for (uintptr_t i = 0; i < allocator_length; i++) {
-        if (test(i) != _val) {
+    size_t i     = 0;
+    // 按字遍历位图
+    while (i < map_words) {
+        // 查找空闲位时，跳过摘要位图中连续已满的字
+        if (_val == false) {
+            uintptr_t full = summary[i >> SHIFT] >> (i & MASK);
+            if ((full & 1) != 0) {
+                count = 0;
+                // 连续已满的字数
+                if (full == ~(uintptr_t)0) {
+                    i += WORD_BITS;
+                }
+                else {
+                    i += __builtin_ctzl(~full);
+                }
+                continue;
+            }
+        }
+        // 转换为 1 表示符合要求
+        uintptr_t bits = _val ? map[i] : ~map[i];
+        // 最后一个字中超出范围的部分视为不符合
+        if ((i == map_words - 1) && ((allocator_length & MASK) != 0)) {
+            bits &= mask(0, allocator_length & MASK);
+        }
+        // 整个字都符合，与之前的连续段连接
+        if (bits == ~(uintptr_t)0) {
+            if (count == 0) {
+                idx = i << SHIFT;
+            }
+            count += WORD_BITS;
+            if (count >= _len) {
+                return idx;
+            }
+            i++;
+            continue;
+        }
+        // 整个字都不符合，直接跳过
+        if (bits == 0) {
             count = 0;
-            idx   = i + 1;
+            i++;
+            continue;
         }
-        else {
-            count++;
+        // 低位的连续段与上一个字的结尾连接
+        size_t head = __builtin_ctzl(~bits);
+        if (count == 0) {
+            idx = i << SHIFT;
         }
-        if (count == _len) {
+        if (count + head >= _len) {
             return idx;
         }
+        // 字内部的连续段，只有 _len 小于字长时才可能满足
+        if (_len < WORD_BITS) {
+            size_t bit = head;
+            while (bit < WORD_BITS) {
+                uintptr_t rest = bits >> bit;
+                if (rest == 0) {
+                    break;
+                }
+                // 跳过不符合的位
+                bit  += __builtin_ctzl(rest);
+                rest  = bits >> bit;
+                // 连续符合的位数
+                // rest 的最高位一定为 0，~rest 不为 0
+                size_t run = __builtin_ctzl(~rest);
+                if (run >= _len) {
+                    return (i << SHIFT) + bit;
+                }
+                bit += run;
+            }
+        }
+        // 高位的连续段延续到下一个字
+        count = __builtin_clzl(~bits);
+        idx   = ((i + 1) << SHIFT) - count;
+        i++;
     }
     return ~(size_t)0;
 }
 
-FIRSTFIT::FIRSTFIT(const char* _name, uintptr_t _addr, size_t _len)
+size_t FIRSTFIT::get_meta_size(size_t _len) {
+    // 位图的字数
+    size_t words = (_len + MASK) >> SHIFT;
+    // 摘要位图的字数
+    size_t sums  = (words + MASK) >> SHIFT;
+    return (words + sums) * sizeof(uintptr_t);
+}
+
+FIRSTFIT::FIRSTFIT(const char* _name, uintptr_t _addr, size_t _len,
+                   void* _meta)
     : ALLOCATOR(_name, _addr, _len) {
+    map_words = (allocator_length + MASK) >> SHIFT;
+    // 摘要位图紧跟在位图之后
+    map       = (uintptr_t*)_meta;
+    summary   = map + map_words;
     // 所有清零
-    bzero(map, sizeof(map));
+    bzero(map, get_meta_size(allocator_length));
+    // 最后一个字中超出范围的位标记为已使用
+    if ((allocator_length & MASK) != 0) {
+        set_range(allocator_length, WORD_BITS - (allocator_length & MASK));
+    }
     info("%s: 0x%p(0x%X pages) init.\n", name, allocator_start_addr,
          allocator_length);
     return;
@@ -76,11 +210,8 @@ uintptr_t FIRSTFIT::alloc(size_t _len) {
         // err("NO ENOUGH MEM.\n");
         return res_addr;
     }
-    // 遍历区域
-    for (auto i = idx; i < idx + _len; i++) {
-        // 置位，说明已使用
-        set(i);
-    }
+    // 置位，说明已使用
+    set_range(idx, _len);
     // 计算实际地址
     // 分配器起始地址+页长度*第几页
     res_addr              = allocator_start_addr + (COMMON::PAGE_SIZE * idx);
@@ -99,19 +230,16 @@ bool FIRSTFIT::alloc(uintptr_t _addr, size_t _len) {
     }
     // 计算 _addr 在 map 中的索引
     size_t idx = (_addr - allocator_start_addr) / COMMON::PAGE_SIZE;
-    // 遍历
-    for (auto i = idx; i < idx + _len; i++) {
-        // 如果在范围内有已经分配的内存，返回 false
-        if (test(i) == true) {
-            return false;
-        }
+    // 超出管理范围
+    if (idx + _len > allocator_length) {
+        return false;
     }
-    // 到这里说明范围内没有已使用内存
-    // 再次遍历
-    for (auto i = idx; i < idx + _len; i++) {
-        // 置位
-        set(i);
+    // 如果在范围内有已经分配的内存，返回 false
+    if (test_range(idx, _len) == true) {
+        return false;
     }
+    // 到这里说明范围内没有已使用内存，置位
+    set_range(idx, _len);
     // 更新统计信息
     allocator_free_count -= _len;
     allocator_used_count += _len;
@@ -127,9 +255,7 @@ void FIRSTFIT::free(uintptr_t _addr, size_t _len) {
     }
     // 计算 _addr 在 map 中的索引
     size_t idx = (_addr - allocator_start_addr) / COMMON::PAGE_SIZE;
-    for (auto i = idx; i < idx + _len; i++) {
-        clr(i);
-    }
+    clr_range(idx, _len);
     // 更新统计信息
     allocator_free_count += _len;
     allocator_used_count -= _len;
@@ -143,3 +269,40 @@ size_t FIRSTFIT::get_used_count(void) const {
 size_t FIRSTFIT::get_free_count(void) const {
     return allocator_free_count;
 }
+
+size_t FIRSTFIT::get_free_blocks(size_t* _hist, size_t _orders) const {
+    for (size_t i = 0; i < _orders; i++) {
+        _hist[i] = 0;
+    }
+    size_t ret    = 0;
+    size_t run    = 0;
+    // 一段连续空闲结束时计入统计
+    auto   record = [&](void) {
+        if (run == 0) {
+            return;
+        }
+        size_t order = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(run);
+        _hist[order < _orders ? order : _orders - 1]++;
+        if (run > ret) {
+            ret = run;
+        }
+        run = 0;
+    };
+    for (size_t i = 0; i < map_words; i++) {
+        // 整字空闲
+        if (map[i] == 0) {
+            run += WORD_BITS;
+            continue;
+        }
+        for (size_t j = 0; j < WORD_BITS; j++) {
+            if ((map[i] & ((uintptr_t)1 << j)) != 0) {
+                record();
+            }
+            else {
+                run++;
+            }
+        }
+    }
+    record();
+    return ret;
+}
@@ -15,10 +15,85 @@
  */
 
 #include "heap.h"
+#include "cassert"
 #include "common.h"
 #include "cstdio"
 #include "pmm.h"
 
+/// kmalloc 对象缓存的长度，从小到大
+static constexpr const size_t KMALLOC_SIZES[] = {
+    8, 16, 32, 48, 64, 96, 128, 192, 256, 512, 1024, 2048, 4096, 8192,
+};
+
+/// kmalloc 对象缓存的名称
+static const char* const      KMALLOC_NAMES[] = {
+    "kmalloc-8",    "kmalloc-16",   "kmalloc-32",   "kmalloc-48",
+    "kmalloc-64",   "kmalloc-96",   "kmalloc-128",  "kmalloc-192",
+    "kmalloc-256",  "kmalloc-512",  "kmalloc-1024", "kmalloc-2048",
+    "kmalloc-4096", "kmalloc-8192",
+};
+
+/**
+ * @brief kmalloc 长度到对象缓存下标的查找表，编译时生成
+ * 不超过 SMALL_MAX 的按 SMALL_STEP 分级，更大的按 SMALL_MAX 分级
+ */
+struct kmalloc_index_t {
+    static constexpr const size_t SMALL_STEP = 8;
+    static constexpr const size_t SMALL_MAX  = 256;
+    /// 下标为 (长度 + SMALL_STEP - 1) / SMALL_STEP
+    uint8_t small[SMALL_MAX / SMALL_STEP + 1];
+    /// 下标为 (长度 - 1) / SMALL_MAX
+    uint8_t large[KMEM_CACHE_MAX_SIZE / SMALL_MAX];
+
+    constexpr kmalloc_index_t(void) : small(), large() {
+        // 每一项为能容纳该级最大长度的最小的对象缓存
+        size_t idx = 0;
+        for (size_t i = 0; i < SMALL_MAX / SMALL_STEP + 1; i++) {
+            while (KMALLOC_SIZES[idx] < i * SMALL_STEP) {
+                idx++;
+            }
+            small[i] = (uint8_t)idx;
+        }
+        idx = 0;
+        for (size_t i = 0; i < KMEM_CACHE_MAX_SIZE / SMALL_MAX; i++) {
+            while (KMALLOC_SIZES[idx] < (i + 1) * SMALL_MAX) {
+                idx++;
+            }
+            large[i] = (uint8_t)idx;
+        }
+    }
+
+    /**
+     * @brief 获取对象缓存下标
+     * @param  _byte           长度，在 (0, KMEM_CACHE_MAX_SIZE] 内
+     * @return size_t          下标
+     */
+    constexpr size_t operator()(size_t _byte) const {
+        if (_byte <= SMALL_MAX) {
+            return small[(_byte + SMALL_STEP - 1) / SMALL_STEP];
+        }
+        return large[(_byte - 1) / SMALL_MAX];
+    }
+};
+
+static constexpr const kmalloc_index_t KMALLOC_INDEX;
+
+static_assert(KMALLOC_SIZES[sizeof(KMALLOC_SIZES) / sizeof(size_t) - 1]
+                == KMEM_CACHE_MAX_SIZE,
+              "kmalloc caches should cover KMEM_CACHE_MAX_SIZE");
+static_assert((KMALLOC_INDEX(1) == 0) && (KMALLOC_INDEX(33) == 3)
+                && (KMALLOC_INDEX(193) == 8) && (KMALLOC_INDEX(257) == 9)
+                && (KMALLOC_INDEX(KMEM_CACHE_MAX_SIZE) == 13),
+              "bad kmalloc index table");
+
+/**
+ * @brief 回收函数，归还堆中空闲的内存
+ * @return size_t          归还的页数
+ */
+static size_t heap_shrinker(size_t) {
+    return HEAP::get_instance().shrink();
+}
+
 HEAP& HEAP::get_instance(void) {
     /// 定义全局 HEAP 对象
     static HEAP heap;
@@ -37,17 +112,74 @@ bool HEAP::init(void) {
       PMM::get_instance().get_non_kernel_space_length() * COMMON::PAGE_SIZE,
       false);
     allocator_non_kernel = (ALLOCATOR*)&slab_allocator_non_kernel;
+    // kmalloc 的对象缓存
+    static_assert(sizeof(KMALLOC_SIZES) / sizeof(size_t) == KMALLOC_CACHES,
+                  "KMALLOC_SIZES should have KMALLOC_CACHES entries");
+    for (size_t i = 0; i < KMALLOC_CACHES; i++) {
+        kmalloc_caches[i]
+          = kmem_cache_create(KMALLOC_NAMES[i], KMALLOC_SIZES[i], 0);
+        assert(kmalloc_caches[i] != nullptr);
+    }
+    // 内存不足时归还空闲的内存
+    PMM::get_instance().register_shrinker(heap_shrinker);
     info("heap init.\n");
     return 0;
 }
 
+void* HEAP::large_alloc(size_t _byte) {
+    size_t pages = _byte / COMMON::PAGE_SIZE;
+    if (_byte % COMMON::PAGE_SIZE != 0) {
+        pages += 1;
+    }
+    uintptr_t addr = PMM::get_instance().alloc_pages(pages);
+    if (addr == 0) {
+        return nullptr;
+    }
+    page_t* page  = PMM::get_instance().addr_to_page(addr);
+    page->flags  |= page_t::KMALLOC;
+    page->prev    = (uint32_t)pages;
+    return (void*)addr;
+}
+
+bool HEAP::large_free(void* _p) {
+    if (((uintptr_t)_p & ~COMMON::PAGE_MASK) != 0) {
+        return false;
+    }
+    page_t* page = PMM::get_instance().addr_to_page((uintptr_t)_p);
+    if ((page == nullptr) || ((page->flags & page_t::KMALLOC) == 0)) {
+        return false;
+    }
+    size_t pages  = page->prev;
+    page->flags  &= ~page_t::KMALLOC;
+    page->prev    = page_t::NONE;
+    PMM::get_instance().free_pages((uintptr_t)_p, pages);
+    return true;
+}
+
 void* HEAP::kmalloc(size_t _byte) {
+    // 较小的从能容纳的最小的对象缓存中分配
+    if ((_byte != 0) && (_byte <= KMEM_CACHE_MAX_SIZE)) {
+        return kmalloc_caches[KMALLOC_INDEX(_byte)]->alloc();
+    }
+    // SLAB 不支持的直接分配整页
+    if (_byte > KMALLOC_LARGE) {
+        return large_alloc(_byte);
+    }
     void* ret = nullptr;
     ret       = (void*)allocator_kernel->alloc(_byte);
     return ret;
 }
 
 void HEAP::kfree(void* _addr) {
+    // 对象缓存的页在页描述符中有标记
+    kmem_cache_t* cache = kmem_cache_t::find(_addr);
+    if (cache != nullptr) {
+        cache->free(_addr);
+        return;
+    }
+    if (large_free(_addr) == true) {
+        return;
+    }
     // 堆不需要 _len 参数
     allocator_kernel->free((uintptr_t)_addr, 0);
     return;
@@ -65,6 +197,30 @@ void HEAP::free(void* _addr) {
     return;
 }
 
+size_t HEAP::shrink(void) {
+    size_t ret = 0;
+    for (size_t i = 0; i < KMALLOC_CACHES; i++) {
+        ret += kmalloc_caches[i]->shrink();
+    }
+    ret += ((SLAB*)allocator_kernel)->shrink();
+    ret += ((SLAB*)allocator_non_kernel)->shrink();
+    return ret;
+}
+
+kmem_stat_t HEAP::get_kmalloc_stat(void) const {
+    kmem_stat_t ret = { 0, 0, 0, 0, 0, 0 };
+    for (size_t i = 0; i < KMALLOC_CACHES; i++) {
+        kmem_stat_t stat  = kmalloc_caches[i]->get_stat();
+        ret.alloc        += stat.alloc;
+        ret.alloc_hit    += stat.alloc_hit;
+        ret.free         += stat.free;
+        ret.free_hit     += stat.free_hit;
+        ret.refill       += stat.refill;
+        ret.flush        += stat.flush;
+    }
+    return ret;
+}
+
 /**
  * @brief 分配内核空间内存
  * @param  _size           要申请的 bytes
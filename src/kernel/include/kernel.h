@@ -29,6 +29,18 @@ extern "C" void kernel_main(void);
  */
 int             test_pmm(void);
 
+/**
+ * @brief FIRSTFIT 位图性能测试函数
+ * @return int             0 成功
+ */
+int             test_firstfit(void);
+
+/**
+ * @brief 页分配器基准测试函数
+ * @return int             0 成功
+ */
+int             test_alloc_bench(void);
+
 /**
  * @brief 虚拟内存测试函数
  * @return int             0 成功
@@ -41,6 +53,18 @@ int             test_vmm(void);
  */
 int             test_heap(void);
 
+/**
+ * @brief 对象缓存测试函数
+ * @return int             0 成功
+ */
+int             test_kmem_cache(void);
+
+/**
+ * @brief 地址空间测试函数
+ * @return int             0 成功
+ */
+int             test_mm(void);
+
 /**
  * @brief 中断测试函数
  * @return int             0 成功
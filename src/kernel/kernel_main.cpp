@@ -38,6 +38,12 @@ void kernel_main(void) {
     PMM::get_instance().init();
     // 测试物理内存
     test_pmm();
+#ifdef SIMPLEKERNEL_ALLOC_BENCH
+    // 测试 FIRSTFIT 位图
+    test_firstfit();
+    // 页分配器基准测试
+    test_alloc_bench();
+#endif
     // 虚拟内存初始化
     /// @todo 将vmm的初始化放在构造函数里，这里只做开启分页
     VMM::get_instance().init();
@@ -47,6 +53,10 @@ void kernel_main(void) {
     HEAP::get_instance().init();
     // 测试堆
     test_heap();
+    // 测试对象缓存
+    test_kmem_cache();
+    // 测试地址空间
+    test_mm();
     // 中断初始化
     INTR::get_instance().init();
     // 测试中断
@@ -59,7 +69,10 @@ void kernel_main(void) {
     show_info();
     // 进入死循环
     while (1) {
-        ;
+        // 空闲时回收低于低水位的 zone
+        PMM::get_instance().balance_zones();
+        // 空闲时预先清零物理页
+        PMM::get_instance().refill_zero_pool();
     }
     // 不应该执行到这里
     assert(0);
@@ -0,0 +1,348 @@
+
+/**
+ * @file kmem_cache.cpp
+ * @brief 对象缓存实现
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#include "kmem_cache.h"
+#include "cassert"
+#include "cpu.hpp"
+#include "new"
+#include "pmm.h"
+
+void kmem_cache_t::list_add(slab_t** _list, slab_t* _slab) {
+    _slab->prev = nullptr;
+    _slab->next = *_list;
+    if (*_list != nullptr) {
+        (*_list)->prev = _slab;
+    }
+    *_list = _slab;
+    return;
+}
+
+void kmem_cache_t::list_del(slab_t** _list, slab_t* _slab) {
+    if (_slab->prev != nullptr) {
+        _slab->prev->next = _slab->next;
+    }
+    else {
+        *_list = _slab->next;
+    }
+    if (_slab->next != nullptr) {
+        _slab->next->prev = _slab->prev;
+    }
+    return;
+}
+
+kmem_cache_t::slab_t* kmem_cache_t::get_slab(const void* _obj) {
+    page_t* page = PMM::get_instance().addr_to_page((uintptr_t)_obj);
+    if ((page == nullptr) || ((page->flags & page_t::SLAB) == 0)) {
+        return nullptr;
+    }
+    // 页描述符中记录了在 slab 中是第几页
+    return (slab_t*)PMM::get_instance().page_to_addr(page - page->prev);
+}
+
+kmem_cache_t::slab_t* kmem_cache_t::grow(void) {
+    uintptr_t addr = PMM::get_instance().alloc_pages_kernel(pages);
+    if (addr == 0) {
+        return nullptr;
+    }
+    // 每一页都记录在 slab 中的位置，释放时由对象所在的页找到 slab 首页
+    page_t* page = PMM::get_instance().addr_to_page(addr);
+    for (size_t i = 0; i < pages; i++) {
+        page[i].flags |= page_t::SLAB;
+        page[i].prev   = (uint32_t)i;
+    }
+    slab_t* slab   = (slab_t*)addr;
+    slab->cache    = this;
+    slab->freelist = (void*)(addr + offset);
+    slab->inuse    = 0;
+    // 按地址顺序串起所有对象
+    uintptr_t obj  = addr + offset;
+    for (size_t i = 1; i < objs; i++) {
+        *(void**)obj  = (void*)(obj + size);
+        obj          += size;
+    }
+    *(void**)obj = nullptr;
+    list_add(&empty, slab);
+    empty_count++;
+    slab_count++;
+    return slab;
+}
+
+void kmem_cache_t::destroy(slab_t* _slab) {
+    page_t* page = PMM::get_instance().addr_to_page((uintptr_t)_slab);
+    for (size_t i = 0; i < pages; i++) {
+        page[i].flags &= ~page_t::SLAB;
+        page[i].prev   = page_t::NONE;
+    }
+    PMM::get_instance().free_pages((uintptr_t)_slab, pages);
+    slab_count--;
+    return;
+}
+
+kmem_cache_t::kmem_cache_t(const char* _name, size_t _size, size_t _align)
+    : name(_name),
+      size(0),
+      align(_align),
+      offset(0),
+      pages(1),
+      objs(0),
+      full(nullptr),
+      partial(nullptr),
+      empty(nullptr),
+      empty_count(0),
+      slab_count(0),
+      inuse(0) {
+    // 空闲对象中保存指针，至少按字长对齐
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    assert(((align & (align - 1)) == 0) && (align <= COMMON::PAGE_SIZE));
+    assert((_size != 0) && (_size <= KMEM_CACHE_MAX_SIZE));
+    size   = COMMON::ALIGN(_size, align);
+    offset = COMMON::ALIGN(sizeof(slab_t), align);
+    // 对象较大时使用多页的 slab，减少尾部的浪费
+    while ((pages < SLAB_MAX_PAGES)
+           && ((pages * COMMON::PAGE_SIZE - offset) / size < SLAB_MIN_OBJS)) {
+        pages *= 2;
+    }
+    objs = (pages * COMMON::PAGE_SIZE - offset) / size;
+    assert(objs != 0);
+    for (size_t i = 0; i < COMMON::CPU_MAX; i++) {
+        mags[i].count = 0;
+        mags[i].stat  = { 0, 0, 0, 0, 0, 0 };
+    }
+    return;
+}
+
+kmem_cache_t::~kmem_cache_t(void) {
+    // 所有对象都已经释放，magazine 中的对象可以直接归还
+    for (size_t i = 0; i < COMMON::CPU_MAX; i++) {
+        mag_flush(&mags[i], mags[i].count);
+    }
+    assert((inuse == 0) && (full == nullptr) && (partial == nullptr));
+    shrink();
+    return;
+}
+
+void* kmem_cache_t::slab_alloc(void) {
+    // 优先使用部分分配的 slab，其次是空 slab，都没有时分配新的
+    slab_t* slab = partial;
+    if (slab == nullptr) {
+        slab = empty;
+        if (slab == nullptr) {
+            slab = grow();
+            if (slab == nullptr) {
+                return nullptr;
+            }
+        }
+        list_del(&empty, slab);
+        empty_count--;
+        list_add(&partial, slab);
+    }
+    void* obj      = slab->freelist;
+    slab->freelist = *(void**)obj;
+    slab->inuse++;
+    inuse++;
+    if (slab->inuse == objs) {
+        list_del(&partial, slab);
+        list_add(&full, slab);
+    }
+    return obj;
+}
+
+void kmem_cache_t::slab_free(void* _obj) {
+    slab_t* slab = get_slab(_obj);
+    assert((slab != nullptr) && (slab->cache == this));
+    if (slab->inuse == objs) {
+        list_del(&full, slab);
+        list_add(&partial, slab);
+    }
+    *(void**)_obj  = slab->freelist;
+    slab->freelist = _obj;
+    slab->inuse--;
+    inuse--;
+    if (slab->inuse == 0) {
+        list_del(&partial, slab);
+        // 保留少量空 slab，避免在边界上反复向 PMM 申请与归还
+        if (empty_count < FREE_MAX) {
+            list_add(&empty, slab);
+            empty_count++;
+        }
+        else {
+            destroy(slab);
+        }
+    }
+    return;
+}
+
+kmem_cache_t::magazine_t* kmem_cache_t::get_mag(void) {
+    size_t core_id = CPU::GET_CORE_ID();
+    assert(core_id < COMMON::CPU_MAX);
+    return &mags[core_id];
+}
+
+void kmem_cache_t::mag_flush(magazine_t* _mag, size_t _count) {
+    assert(_count <= _mag->count);
+    if (_count == 0) {
+        return;
+    }
+    _mag->stat.flush++;
+    // 归还栈底的冷对象，剩余的移到栈底
+    for (size_t i = 0; i < _count; i++) {
+        slab_free(_mag->objs[i]);
+    }
+    for (size_t i = _count; i < _mag->count; i++) {
+        _mag->objs[i - _count] = _mag->objs[i];
+    }
+    _mag->count -= _count;
+    return;
+}
+
+void* kmem_cache_t::alloc(void) {
+    magazine_t* mag = get_mag();
+    mag->stat.alloc++;
+    if (mag->count == 0) {
+        // 从 slab 补充一批，失败说明内存不足
+        mag->stat.refill++;
+        while (mag->count < MAG_BATCH) {
+            void* obj = slab_alloc();
+            if (obj == nullptr) {
+                break;
+            }
+            mag->objs[mag->count] = obj;
+            mag->count++;
+        }
+        if (mag->count == 0) {
+            return nullptr;
+        }
+    }
+    else {
+        mag->stat.alloc_hit++;
+    }
+    // 从栈顶取出最热的对象
+    mag->count--;
+    return mag->objs[mag->count];
+}
+
+void kmem_cache_t::free(void* _obj) {
+    if (_obj == nullptr) {
+        return;
+    }
+    assert(find(_obj) == this);
+    magazine_t* mag = get_mag();
+    mag->stat.free++;
+    // magazine 已满，归还栈底的一批
+    if (mag->count == MAG_SIZE) {
+        mag_flush(mag, MAG_BATCH);
+    }
+    else {
+        mag->stat.free_hit++;
+    }
+    mag->objs[mag->count] = _obj;
+    mag->count++;
+    return;
+}
+
+size_t kmem_cache_t::shrink(void) {
+    magazine_t* mag = get_mag();
+    mag_flush(mag, mag->count);
+    size_t ret = 0;
+    while (empty != nullptr) {
+        slab_t* slab = empty;
+        list_del(&empty, slab);
+        destroy(slab);
+        ret += pages;
+    }
+    empty_count = 0;
+    return ret;
+}
+
+const char* kmem_cache_t::get_name(void) const {
+    return name;
+}
+
+size_t kmem_cache_t::get_size(void) const {
+    return size;
+}
+
+size_t kmem_cache_t::get_inuse(void) const {
+    return inuse;
+}
+
+size_t kmem_cache_t::get_slab_count(void) const {
+    return slab_count;
+}
+
+kmem_stat_t kmem_cache_t::get_stat(void) const {
+    kmem_stat_t ret = { 0, 0, 0, 0, 0, 0 };
+    for (size_t i = 0; i < COMMON::CPU_MAX; i++) {
+        ret.alloc     += mags[i].stat.alloc;
+        ret.alloc_hit += mags[i].stat.alloc_hit;
+        ret.free      += mags[i].stat.free;
+        ret.free_hit  += mags[i].stat.free_hit;
+        ret.refill    += mags[i].stat.refill;
+        ret.flush     += mags[i].stat.flush;
+    }
+    return ret;
+}
+
+kmem_cache_t* kmem_cache_t::find(const void* _obj) {
+    slab_t* slab = get_slab(_obj);
+    if (slab == nullptr) {
+        return nullptr;
+    }
+    return slab->cache;
+}
+
+/**
+ * @brief 获取分配缓存描述符的缓存
+ * @return kmem_cache_t&   静态对象
+ */
+static kmem_cache_t& get_cache_cache(void) {
+    static kmem_cache_t cache_cache("kmem_cache", sizeof(kmem_cache_t), 0);
+    return cache_cache;
+}
+
+kmem_cache_t* kmem_cache_create(const char* _name, size_t _size,
+                                size_t _align) {
+    if ((_size == 0) || (_size > KMEM_CACHE_MAX_SIZE)
+        || ((_align & (_align - 1)) != 0) || (_align > COMMON::PAGE_SIZE)) {
+        return nullptr;
+    }
+    // 缓存描述符本身也由对象缓存分配
+    void* addr = get_cache_cache().alloc();
+    if (addr == nullptr) {
+        return nullptr;
+    }
+    return new (addr) kmem_cache_t(_name, _size, _align);
+}
+
+void kmem_cache_destroy(kmem_cache_t* _cache) {
+    if (_cache == nullptr) {
+        return;
+    }
+    _cache->~kmem_cache_t();
+    get_cache_cache().free(_cache);
+    return;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* _cache) {
+    return _cache->alloc();
+}
+
+void kmem_cache_free(kmem_cache_t* _cache, void* _obj) {
+    _cache->free(_obj);
+    return;
+}
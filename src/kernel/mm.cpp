@@ -0,0 +1,384 @@
+
+/**
+ * @file mm.cpp
+ * @brief 地址空间实现
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#include "mm.h"
+#include "cassert"
+#include "common.h"
+#include "cstring"
+#include "pmm.h"
+
+mm_t*     mm_t::current   = nullptr;
+uintptr_t mm_t::zero_page = 0;
+
+uintptr_t mm_t::get_zero_page(void) {
+    if (zero_page == 0) {
+        zero_page = PMM::get_instance().alloc_zeroed_page();
+    }
+    return zero_page;
+}
+
+bool mm_t::mergeable(const vma_t& _prev, const vma_t& _next) {
+    if ((_prev.end != _next.start) || (_prev.flag != _next.flag)
+        || (_prev.type != _next.type) || (_prev.ref != _next.ref)) {
+        return false;
+    }
+    // 物理内存区域还需要物理地址连续
+    if (_prev.type == vma_t::PHYS) {
+        return _prev.pa + (_prev.end - _prev.start) == _next.pa;
+    }
+    return true;
+}
+
+mm_t::vma_tree_t::iterator mm_t::split(vma_tree_t::iterator _it,
+                                       uintptr_t            _addr) {
+    assert((_addr > _it->second.start) && (_addr < _it->second.end));
+    vma_t vma = _it->second;
+    if (vma.type == vma_t::PHYS) {
+        vma.pa += _addr - vma.start;
+    }
+    vma.start       = _addr;
+    _it->second.end = _addr;
+    return vmas.insert(mystl::make_pair(_addr, vma)).first;
+}
+
+bool mm_t::cow(const vma_t* _vma, uintptr_t _va, uintptr_t _pa) {
+    page_t* page = PMM::get_instance().addr_to_page(_pa);
+    // 物理内存区域是共享的，匿名页没有被共享时也不需要复制
+    if ((_vma->type == vma_t::ANON) && (page != nullptr) && (page->ref > 1)) {
+        uintptr_t pa = 0;
+        if (_pa == zero_page) {
+            pa = PMM::get_instance().alloc_zeroed_page();
+        }
+        else {
+            pa = PMM::get_instance().alloc_page();
+            if (pa != 0) {
+                memcpy((void*)VMM_PA2VA(pa), (void*)VMM_PA2VA(_pa),
+                       COMMON::PAGE_SIZE);
+            }
+        }
+        if (pa == 0) {
+            return false;
+        }
+        VMM::get_instance().mmap(pgd, _va, pa, _vma->flag);
+        PMM::get_instance().put_page(_pa);
+        return true;
+    }
+    VMM::get_instance().mmap(pgd, _va, _pa, _vma->flag);
+    return true;
+}
+
+size_t mm_t::populate(const vma_t* _vma, uintptr_t _start, uintptr_t _end,
+                      bool _write) {
+    assert(_vma->type == vma_t::ANON);
+    uint32_t  flag = _write ? _vma->flag
+                            : _vma->flag & ~(uint32_t)VMM_PAGE_WRITABLE;
+    size_t    ret  = 0;
+    uintptr_t step = MM_BATCH_PAGES * COMMON::PAGE_SIZE;
+    uintptr_t pas[MM_BATCH_PAGES];
+    for (auto va = _start; va < _end; va += step) {
+        size_t n = (_end - va) / COMMON::PAGE_SIZE;
+        if (n > MM_BATCH_PAGES) {
+            n = MM_BATCH_PAGES;
+        }
+        bool stop = false;
+        for (size_t i = 0; i < n; i++) {
+            pas[i] = 0;
+            if ((stop == true)
+                || (VMM::get_instance().get_mmap(
+                      pgd, va + i * COMMON::PAGE_SIZE, nullptr)
+                    == true)) {
+                continue;
+            }
+            // 读取映射零页
+            if (_write == false) {
+                pas[i] = get_zero_page();
+                if (pas[i] != 0) {
+                    PMM::get_instance().get_page(pas[i]);
+                }
+            }
+            // 写入分配清零的页
+            else {
+                pas[i] = PMM::get_instance().alloc_zeroed_page();
+            }
+            if (pas[i] == 0) {
+                stop = true;
+                continue;
+            }
+            ret++;
+        }
+        VMM::get_instance().mmap_pages(pgd, va, pas, n, flag);
+        if (stop == true) {
+            break;
+        }
+    }
+    return ret;
+}
+
+void mm_t::release(const vma_t& _vma) {
+    // 保护页从未映射
+    if (_vma.type == vma_t::GUARD) {
+        return;
+    }
+    // 匿名页由区域持有，在取消映射前归还，复制出的地址空间与零页可能共享
+    // 物理内存区域由其所有者释放，只归还复制地址空间时增加的引用
+    // 页在 unmap_range 刷新 TLB 前不会被再次分配
+    for (auto va = _vma.start; va < _vma.end; va += COMMON::PAGE_SIZE) {
+        uintptr_t pa = 0;
+        if (VMM::get_instance().get_mmap(pgd, va, &pa) == false) {
+            continue;
+        }
+        page_t* page = PMM::get_instance().addr_to_page(pa);
+        if ((page == nullptr) || (page->ref == 0)) {
+            continue;
+        }
+        if ((_vma.type == vma_t::ANON) || (_vma.ref == true)) {
+            PMM::get_instance().put_page(pa);
+        }
+    }
+    VMM::get_instance().unmap_range(pgd, _vma.start, _vma.end - _vma.start);
+    return;
+}
+
+mm_t::mm_t(pt_t _pgd)
+  : pgd(_pgd), own_pgd(false), fault_around(MM_FAULT_AROUND_PAGES) {
+    assert(pgd != nullptr);
+    return;
+}
+
+mm_t::~mm_t(void) {
+    for (auto it = vmas.begin(); it != vmas.end(); ++it) {
+        release(it->second);
+    }
+    if (current == this) {
+        current = nullptr;
+    }
+    if (own_pgd == true) {
+        VMM::get_instance().free_pgd(pgd);
+    }
+    return;
+}
+
+mm_t* mm_t::clone(void) const {
+    pt_t pgd_new = VMM::get_instance().clone(pgd);
+    if (pgd_new == nullptr) {
+        return nullptr;
+    }
+    mm_t* mm         = new mm_t(pgd_new);
+    mm->own_pgd      = true;
+    mm->fault_around = fault_around;
+    // 只复制区域所在的页表，区域中的页写时复制，内核的映射在两边共享
+    // 失败时新的地址空间只包含已经复制的区域，直接析构即可
+    for (auto it = vmas.begin(); it != vmas.end(); ++it) {
+        if ((it->second.type != vma_t::GUARD)
+            && (VMM::get_instance().cow_range(
+                  pgd, pgd_new, it->second.start,
+                  it->second.end - it->second.start)
+                == false)) {
+            delete mm;
+            return nullptr;
+        }
+        // 复制出的物理内存区域对映射的页持有引用
+        auto vma = mm->vmas.insert(mystl::make_pair(it->first, it->second));
+        if (it->second.type == vma_t::PHYS) {
+            vma.first->second.ref = true;
+        }
+    }
+    return mm;
+}
+
+mm_t* mm_t::get_current(void) {
+    return current;
+}
+
+void mm_t::switch_to(void) {
+    current = this;
+    VMM::get_instance().set_pgd(pgd);
+    return;
+}
+
+pt_t mm_t::get_pgd(void) const {
+    return pgd;
+}
+
+void mm_t::set_fault_around(size_t _pages) {
+    assert((_pages != 0) && ((_pages & (_pages - 1)) == 0)
+           && (_pages <= MM_BATCH_PAGES));
+    fault_around = _pages;
+    return;
+}
+
+size_t mm_t::get_fault_around(void) const {
+    return fault_around;
+}
+
+size_t mm_t::get_vma_count(void) const {
+    return vmas.size();
+}
+
+const vma_t* mm_t::find_vma(uintptr_t _addr) const {
+    // 第一个起始地址大于 _addr 的区域的前一个区域可能包含 _addr
+    auto it = vmas.upper_bound(_addr);
+    if (it == vmas.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (_addr >= it->second.end) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+bool mm_t::mmap(uintptr_t _addr, size_t _len, uint32_t _flag,
+                vma_t::type_t _type, uintptr_t _pa) {
+    uintptr_t end = _addr + _len;
+    if ((_len == 0) || (end < _addr)
+        || (((_addr | _len | _pa) & ~COMMON::PAGE_MASK) != 0)) {
+        return false;
+    }
+    // 不能与内核的恒等映射与直接映射共享顶级页表项，
+    // 复制地址空间时它们所在的页表在所有地址空间中共享
+    uintptr_t identity_start
+      = (uintptr_t)COMMON::KERNEL_START_ADDR & ~(VMM_PGD_ENTRY_SIZE - 1);
+    uintptr_t identity_end
+      = COMMON::ALIGN(PMM::get_instance().get_pmm_end(), VMM_PGD_ENTRY_SIZE);
+    uintptr_t direct_end
+      = COMMON::ALIGN(KERNEL_OFFSET + VMM_DIRECT_MAP_SIZE, VMM_PGD_ENTRY_SIZE);
+    if (((_addr < identity_end) && (end > identity_start))
+        || ((_addr < direct_end) && (end > KERNEL_OFFSET))) {
+        return false;
+    }
+    // 不能与已有区域重叠
+    auto next = vmas.lower_bound(_addr);
+    auto prev = vmas.end();
+    if ((next != vmas.end()) && (next->second.start < end)) {
+        return false;
+    }
+    if (next != vmas.begin()) {
+        prev = next;
+        --prev;
+        if (prev->second.end > _addr) {
+            return false;
+        }
+    }
+    bool  populate_all  = (_flag & MM_MAP_POPULATE) != 0;
+    _flag              &= ~MM_MAP_POPULATE;
+    vma_t vma           = { _addr, end, _flag, _type, _pa, false };
+    // 物理内存区域立即映射
+    if (_type == vma_t::PHYS) {
+        VMM::get_instance().mmap_range(pgd, _addr, _pa, _len, _flag);
+    }
+    // 与前一个区域合并
+    auto it = vmas.end();
+    if ((prev != vmas.end()) && (mergeable(prev->second, vma) == true)) {
+        prev->second.end = end;
+        it               = prev;
+    }
+    else {
+        it = vmas.insert(mystl::make_pair(_addr, vma)).first;
+    }
+    // 与后一个区域合并
+    if ((next != vmas.end()) && (mergeable(it->second, next->second) == true)) {
+        it->second.end = next->second.end;
+        vmas.erase(next);
+    }
+    // 预先映射整个匿名区域，可写的分配清零的页，只读的映射零页
+    if ((populate_all == true) && (_type == vma_t::ANON)) {
+        populate(&it->second, _addr, end, (_flag & VMM_PAGE_WRITABLE) != 0);
+    }
+    return true;
+}
+
+bool mm_t::munmap(uintptr_t _addr, size_t _len) {
+    uintptr_t end = _addr + _len;
+    if ((_len == 0) || (end < _addr)
+        || (((_addr | _len) & ~COMMON::PAGE_MASK) != 0)) {
+        return false;
+    }
+    // 从包含 _addr 的区域或其后第一个区域开始
+    auto it = vmas.upper_bound(_addr);
+    if (it != vmas.begin()) {
+        auto prev = it;
+        --prev;
+        if (prev->second.end > _addr) {
+            it = prev;
+        }
+    }
+    while ((it != vmas.end()) && (it->second.start < end)) {
+        // 范围之外的部分分割出来保留
+        if (it->second.start < _addr) {
+            it = split(it, _addr);
+        }
+        if (it->second.end > end) {
+            split(it, end);
+        }
+        release(it->second);
+        auto next = it;
+        ++next;
+        vmas.erase(it);
+        it = next;
+    }
+    return true;
+}
+
+bool mm_t::fault(uintptr_t _addr, bool _write) {
+    const vma_t* vma = find_vma(_addr);
+    if ((vma == nullptr) || (vma->type == vma_t::GUARD)) {
+        return false;
+    }
+    if ((_write == true) && ((vma->flag & VMM_PAGE_WRITABLE) == 0)) {
+        return false;
+    }
+    uintptr_t va   = _addr & COMMON::PAGE_MASK;
+    uintptr_t pa   = 0;
+    uint32_t  flag = 0;
+    if (VMM::get_instance().get_mmap(pgd, va, &pa, &flag) == true) {
+        // 写入共享的只读页
+        if ((_write == true) && ((flag & VMM_PAGE_WRITABLE) == 0)) {
+            return cow(vma, va, pa);
+        }
+        // 已经映射过了，是过期的 TLB 项引起的缺页
+        return true;
+    }
+    if (vma->type == vma_t::PHYS) {
+        pa           = vma->pa + (va - vma->start);
+        // 与 clone 一样，对已分配的页持有引用
+        page_t* page = PMM::get_instance().addr_to_page(pa);
+        if ((vma->ref == true) && (page != nullptr) && (page->ref != 0)) {
+            PMM::get_instance().get_page(pa);
+        }
+        VMM::get_instance().mmap(pgd, va, pa, vma->flag);
+        return true;
+    }
+    // 读取没有写过的匿名页时映射只读的零页，第一次写入时再分配
+    if (populate(vma, va, va + COMMON::PAGE_SIZE, _write) == 0) {
+        return false;
+    }
+    // 顺序读取时一起映射相邻的页，减少缺页次数
+    // 相邻的页都映射零页，写缺页不处理，避免分配不会被访问的页
+    if ((_write == false) && (fault_around > 1)) {
+        uintptr_t size  = fault_around * COMMON::PAGE_SIZE;
+        uintptr_t start = va & ~(size - 1);
+        uintptr_t end   = start + size;
+        if (start < vma->start) {
+            start = vma->start;
+        }
+        if (end > vma->end) {
+            end = vma->end;
+        }
+        populate(vma, start, end, false);
+    }
+    return true;
+}
@@ -20,8 +20,475 @@
 #include "common.h"
 #include "cstdio"
 #include "cstring"
+#include "new"
 #include "resource.h"
 
+uintptr_t PMM::early_alloc(size_t _len) {
+    // 按字长对齐
+    uintptr_t ret = COMMON::ALIGN(early_end, sizeof(uintptr_t));
+    early_end     = ret + _len;
+    // 不能超出限制
+    assert(early_end <= kernel_space_start + EARLY_SIZE);
+    return ret;
+}
+
+uintptr_t PMM::meta_alloc(size_t _len) {
+    // 按字长对齐
+    uintptr_t ret = COMMON::ALIGN(meta_end, sizeof(uintptr_t));
+    meta_end      = ret + _len;
+    // 不能超出 init_pages 划出的范围
+    assert(meta_end <= meta_limit);
+    return ret;
+}
+
+size_t PMM::get_allocator_size(size_t _len) const {
+    // 分配器对象之后紧跟元数据
+    if (ALLOCATOR_TYPE == BUDDY_ALLOCATOR) {
+        return COMMON::ALIGN(sizeof(BUDDY), sizeof(uintptr_t))
+             + BUDDY::get_meta_size(_len);
+    }
+    return COMMON::ALIGN(sizeof(FIRSTFIT), sizeof(uintptr_t))
+         + FIRSTFIT::get_meta_size(_len);
+}
+
+ALLOCATOR* PMM::create_allocator(bool _kernel, uintptr_t _addr, size_t _len) {
+    ALLOCATOR* ret  = nullptr;
+    // 内核空间的元数据放在启动阶段的内存中，其余的放在从区域中划出的内存中
+    size_t     size = get_allocator_size(_len);
+    uintptr_t  mem  = _kernel ? early_alloc(size) : meta_alloc(size);
+    if (ALLOCATOR_TYPE == BUDDY_ALLOCATOR) {
+        void* meta = (void*)(mem + COMMON::ALIGN(sizeof(BUDDY),
+                                                 sizeof(uintptr_t)));
+        ret        = (ALLOCATOR*)new ((void*)mem)
+          BUDDY(_kernel ? "Buddy Allocator(kernel space)" : "Buddy Allocator",
+                _addr, _len, meta);
+    }
+    else {
+        // 位图大小由实际页数决定
+        void* meta = (void*)(mem + COMMON::ALIGN(sizeof(FIRSTFIT),
+                                                 sizeof(uintptr_t)));
+        ret        = (ALLOCATOR*)new ((void*)mem)
+          FIRSTFIT(_kernel ? "First Fit Allocator(kernel space)"
+                           : "First Fit Allocator",
+                   _addr, _len, meta);
+    }
+    return ret;
+}
+
+void PMM::init_pages(void) {
+    // 区域都位于内核空间之后，数组从内核空间开始，到最后一个区域或 cma 结束
+    uintptr_t lo = kernel_space_start;
+    uintptr_t hi = kernel_space_start + kernel_space_length;
+    if (region_count > 0) {
+        hi = regions[region_count - 1].start
+           + regions[region_count - 1].length;
+    }
+    if ((cma.length != 0) && (cma.start + cma.length > hi)) {
+        hi = cma.start + cma.length;
+    }
+    pages_base  = lo >> COMMON::PAGE_SHIFT;
+    pages_count = (hi - lo) / COMMON::PAGE_SIZE;
+    // 描述符数组与非内核空间分配器的元数据随内存大小增长，
+    // 启动阶段的内存放不下，计算总长度后一次划出
+    // 每次分配最多因对齐浪费一个字
+    size_t len  = pages_count * sizeof(page_t) + sizeof(uintptr_t);
+    for (size_t i = 0; i < region_count; i++) {
+        len += get_allocator_size(regions[i].length / COMMON::PAGE_SIZE)
+             + sizeof(uintptr_t);
+    }
+    if (cma.length != 0) {
+        len += get_allocator_size(cma.length / COMMON::PAGE_SIZE)
+             + sizeof(uintptr_t);
+    }
+    len      = COMMON::ALIGN(len, COMMON::PAGE_SIZE);
+    // 从地址最低的足够大的区域开头划出，启动阶段的页表一定能覆盖低地址
+    // 划出后区域变小，分配器的元数据只会比计算的少
+    meta_end = 0;
+    for (size_t i = 0; (i < region_count) && (meta_end == 0); i++) {
+        if (regions[i].length > len) {
+            meta_end           = regions[i].start;
+            regions[i].start  += len;
+            regions[i].length -= len;
+        }
+    }
+    // 没有足够大的区域时使用启动阶段的内存
+    if (meta_end == 0) {
+        meta_end = early_alloc(len);
+    }
+    meta_limit = meta_end + len;
+    pages      = (page_t*)meta_alloc(pages_count * sizeof(page_t));
+    // 默认为空洞，划出的元数据内存也保持为保留
+    for (size_t i = 0; i < pages_count; i++) {
+        pages[i].prev  = page_t::NONE;
+        pages[i].next  = page_t::NONE;
+        pages[i].ref   = 0;
+        pages[i].flags = page_t::RESERVED;
+        pages[i].order = 0;
+    }
+    // 清除受分配器管理的页的标记
+    for (size_t i = 0; i < kernel_space_length / COMMON::PAGE_SIZE; i++) {
+        pages[i].flags = 0;
+    }
+    for (size_t i = 0; i < region_count; i++) {
+        page_t* page = addr_to_page(regions[i].start);
+        for (size_t j = 0; j < regions[i].length / COMMON::PAGE_SIZE; j++) {
+            page[j].flags = 0;
+        }
+    }
+    if (cma.length != 0) {
+        page_t* page = addr_to_page(cma.start);
+        for (size_t i = 0; i < cma.length / COMMON::PAGE_SIZE; i++) {
+            page[i].flags = 0;
+        }
+    }
+    return;
+}
+
+void PMM::set_pages(uintptr_t _addr, size_t _len, bool _alloc) {
+    page_t* page = addr_to_page(_addr);
+    if (page == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < _len; i++) {
+        page[i].ref    = _alloc ? 1 : 0;
+        page[i].flags &= ~page_t::HEAD;
+        page[i].order  = 0;
+    }
+    // 在首页记录块的大小
+    if (_alloc) {
+        page->flags |= page_t::HEAD;
+        while (((size_t)1 << page->order) < _len) {
+            page->order++;
+        }
+    }
+    return;
+}
+
+void PMM::find_regions(void) {
+    resource_t mems[REGION_MAX];
+    // 多出的一项保存内核空间
+    resource_t holes[REGION_MAX + 1];
+    size_t     mem_count  = BOOT_INFO::get_memory_regions(mems, REGION_MAX);
+    size_t     hole_count = BOOT_INFO::get_reserved_regions(holes, REGION_MAX);
+    // 内核空间及其之前的内存也不放入区域
+    holes[hole_count].mem.addr = 0;
+    holes[hole_count].mem.len  = kernel_space_start + kernel_space_length;
+    hole_count++;
+    region_count = 0;
+    for (size_t i = 0; i < mem_count; i++) {
+        // 向内对齐
+        uintptr_t curr = COMMON::ALIGN(mems[i].mem.addr, COMMON::PAGE_SIZE);
+        uintptr_t end
+          = (mems[i].mem.addr + mems[i].mem.len) & COMMON::PAGE_MASK;
+        while (curr < end) {
+            // 找到与 [curr, end) 重叠且起始地址最小的保留区域
+            uintptr_t hole_start = end;
+            uintptr_t hole_end   = end;
+            for (size_t j = 0; j < hole_count; j++) {
+                // 向外对齐
+                uintptr_t start = holes[j].mem.addr & COMMON::PAGE_MASK;
+                uintptr_t stop  = COMMON::ALIGN(
+                  holes[j].mem.addr + holes[j].mem.len, COMMON::PAGE_SIZE);
+                if ((stop > curr) && (start < end) && (start < hole_start)) {
+                    hole_start = start;
+                    hole_end   = stop;
+                }
+            }
+            // 保留区域之前的部分
+            if ((hole_start > curr) && (add_region(curr, hole_start) == false)) {
+                warn("too many memory regions.\n");
+                return;
+            }
+            curr = hole_end;
+        }
+    }
+    return;
+}
+
+void PMM::reserve_cma(void) {
+    cma.start     = 0;
+    cma.length    = 0;
+    cma.allocator = nullptr;
+    // 找到最大的区域
+    region_t* max = nullptr;
+    for (size_t i = 0; i < region_count; i++) {
+        if ((max == nullptr) || (regions[i].length > max->length)) {
+            max = &regions[i];
+        }
+    }
+    // 内存太少时不保留
+    if ((max == nullptr) || (max->length < CMA_SIZE * 4)) {
+        warn("no enough memory for cma.\n");
+        return;
+    }
+    // 从末尾划出，起始地址对齐
+    uintptr_t end = max->start + max->length;
+    cma.start     = (end - CMA_SIZE) & ~(CMA_ALIGN - 1);
+    cma.length    = end - cma.start;
+    max->length  -= cma.length;
+    return;
+}
+
+bool PMM::add_region(uintptr_t _start, uintptr_t _end) {
+    // 跨过 DMA32_END 时拆分
+    if (((uint64_t)_start < DMA32_END) && ((uint64_t)_end > DMA32_END)) {
+        return add_region(_start, (uintptr_t)DMA32_END)
+            && add_region((uintptr_t)DMA32_END, _end);
+    }
+    if (region_count == REGION_MAX) {
+        return false;
+    }
+    // 按地址插入
+    size_t i = region_count;
+    while ((i > 0) && (regions[i - 1].start > _start)) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+    regions[i].start     = _start;
+    regions[i].length    = _end - _start;
+    regions[i].allocator = nullptr;
+    regions[i].zone
+      = ((uint64_t)_start < DMA32_END) ? ZONE_DMA32 : ZONE_NORMAL;
+    region_count++;
+    return true;
+}
+
+void PMM::init_zones(void) {
+    zones[ZONE_KERNEL].name  = "KERNEL";
+    zones[ZONE_KERNEL].pages = kernel_space_length / COMMON::PAGE_SIZE;
+    zones[ZONE_DMA32].name   = "DMA32";
+    zones[ZONE_DMA32].pages  = 0;
+    zones[ZONE_NORMAL].name  = "NORMAL";
+    zones[ZONE_NORMAL].pages = 0;
+    for (size_t i = 0; i < region_count; i++) {
+        zones[regions[i].zone].pages += regions[i].length / COMMON::PAGE_SIZE;
+    }
+    for (size_t i = 0; i < ZONE_MAX; i++) {
+        zones[i].low     = zones[i].pages / WMARK_LOW_RATIO;
+        zones[i].high    = zones[i].pages / WMARK_HIGH_RATIO;
+        zones[i].pending = false;
+        zones[i].hold    = false;
+        info("zone %s: 0x%X pages, low 0x%X, high 0x%X.\n", zones[i].name,
+             zones[i].pages, zones[i].low, zones[i].high);
+    }
+    return;
+}
+
+size_t PMM::zone_free_count(zone_type_t _zone) const {
+    if (_zone == ZONE_KERNEL) {
+        return kernel_space_allocator->get_free_count();
+    }
+    size_t ret = 0;
+    for (size_t i = 0; i < region_count; i++) {
+        if (regions[i].zone == _zone) {
+            ret += regions[i].allocator->get_free_count();
+        }
+    }
+    return ret;
+}
+
+uintptr_t PMM::zone_alloc(zone_type_t _zone, size_t _len) {
+    if (_zone == ZONE_KERNEL) {
+        return kernel_space_allocator->alloc(_len);
+    }
+    uintptr_t ret = 0;
+    // 依次尝试 zone 中的每个区域
+    for (size_t i = 0; (i < region_count) && (ret == 0); i++) {
+        if (regions[i].zone == _zone) {
+            ret = regions[i].allocator->alloc(_len);
+        }
+    }
+    return ret;
+}
+
+uintptr_t PMM::fallback_alloc(zone_type_t _zone, size_t _len,
+                              bool _reclaim) {
+    // 每个 zone 的回退顺序，以 ZONE_MAX 结束
+    static constexpr const zone_type_t fallback[ZONE_MAX][ZONE_MAX + 1] = {
+        {ZONE_KERNEL, ZONE_DMA32, ZONE_NORMAL, ZONE_MAX},
+        {ZONE_DMA32, ZONE_MAX},
+        {ZONE_NORMAL, ZONE_DMA32, ZONE_MAX},
+    };
+    uintptr_t   ret  = 0;
+    zone_type_t zone = ZONE_MAX;
+    // 先保留低水位以下的页
+    for (size_t i = 0; (ret == 0) && (fallback[_zone][i] != ZONE_MAX); i++) {
+        zone = fallback[_zone][i];
+        if (zone_free_count(zone) >= _len + zones[zone].low) {
+            ret = zone_alloc(zone, _len);
+        }
+    }
+    // 回收后忽略水位
+    if ((ret == 0) && _reclaim) {
+        reclaim(_len);
+        for (size_t i = 0; (ret == 0) && (fallback[_zone][i] != ZONE_MAX);
+             i++) {
+            zone = fallback[_zone][i];
+            ret  = zone_alloc(zone, _len);
+        }
+    }
+    // 低于低水位时请求回收，由 balance_zones 在空闲时回收到高水位
+    if ((ret != 0) && (zones[zone].hold == false)
+        && (zone_free_count(zone) < zones[zone].low)) {
+        zones[zone].pending = true;
+    }
+    return ret;
+}
+
+PMM::region_t* PMM::find_region(uintptr_t _addr) {
+    for (size_t i = 0; i < region_count; i++) {
+        if ((_addr >= regions[i].start)
+            && (_addr < regions[i].start + regions[i].length)) {
+            return &regions[i];
+        }
+    }
+    if ((_addr >= cma.start) && (_addr < cma.start + cma.length)) {
+        return &cma;
+    }
+    return nullptr;
+}
+
+PMM::pcp_t* PMM::get_pcp(bool _kernel) {
+    size_t core_id = CPU::GET_CORE_ID();
+    assert(core_id < COMMON::CPU_MAX);
+    return &pcp[core_id][_kernel ? 1 : 0];
+}
+
+void PMM::pcp_refill(pcp_t* _pcp, bool _kernel) {
+    // 先尝试分配连续的页
+    zone_type_t zone = _kernel ? ZONE_KERNEL : ZONE_NORMAL;
+    uintptr_t   addr = fallback_alloc(zone, PCP_BATCH, false);
+    for (size_t i = 0; i < PCP_BATCH; i++) {
+        uintptr_t page = 0;
+        if (addr != 0) {
+            page = addr + i * COMMON::PAGE_SIZE;
+        }
+        // 没有连续的页，逐页分配
+        // 回收会归还页缓存，只在缓存为空时允许
+        else {
+            page = fallback_alloc(zone, 1, _pcp->count == 0);
+            if (page == 0) {
+                break;
+            }
+        }
+        // 放入队首，低地址的页最先被使用
+        _pcp->first = (_pcp->first - 1) & (PCP_SIZE - 1);
+        _pcp->pages[_pcp->first] = page;
+        _pcp->count++;
+    }
+    _pcp->stat.refill++;
+    return;
+}
+
+void PMM::pcp_drain(pcp_t* _pcp, size_t _count) {
+    if (_pcp->count == 0) {
+        return;
+    }
+    // 从队首归还
+    while ((_count > 0) && (_pcp->count > 0)) {
+        allocator_free(_pcp->pages[_pcp->first], 1);
+        _pcp->first = (_pcp->first + 1) & (PCP_SIZE - 1);
+        _pcp->count--;
+        _count--;
+    }
+    _pcp->stat.drain++;
+    return;
+}
+
+uintptr_t PMM::pcp_alloc(bool _kernel) {
+    pcp_t* cache = get_pcp(_kernel);
+    cache->stat.alloc++;
+    if (cache->count == 0) {
+        pcp_refill(cache, _kernel);
+        // 补充失败，说明内存不足
+        if (cache->count == 0) {
+            return 0;
+        }
+    }
+    else {
+        cache->stat.hit++;
+    }
+    // 从队尾取出最热的页
+    cache->count--;
+    return cache->pages[(cache->first + cache->count) & (PCP_SIZE - 1)];
+}
+
+void PMM::pcp_free(uintptr_t _addr, bool _hot) {
+    bool kernel = (_addr >= kernel_space_start)
+               && (_addr < kernel_space_start + kernel_space_length);
+    // 不属于任何分配器
+    if ((kernel == false) && (find_region(_addr) == nullptr)) {
+        assert(0);
+        return;
+    }
+    pcp_t* cache = get_pcp(kernel);
+    // 缓存已满，归还冷端的一批页
+    if (cache->count == PCP_SIZE) {
+        pcp_drain(cache, PCP_BATCH);
+    }
+    if (_hot) {
+        cache->pages[(cache->first + cache->count) & (PCP_SIZE - 1)] = _addr;
+    }
+    else {
+        cache->first               = (cache->first - 1) & (PCP_SIZE - 1);
+        cache->pages[cache->first] = _addr;
+    }
+    cache->count++;
+    return;
+}
+
+size_t PMM::get_pcp_count(void) const {
+    size_t ret = 0;
+    for (size_t i = 0; i < COMMON::CPU_MAX; i++) {
+        ret += pcp[i][0].count + pcp[i][1].count;
+    }
+    return ret;
+}
+
+void PMM::clear_page(uintptr_t _addr) {
+    uintptr_t* p   = (uintptr_t*)_addr;
+    uintptr_t* end = p + COMMON::PAGE_SIZE / sizeof(uintptr_t);
+    // 每次写 8 个字
+    while (p < end) {
+        p[0]  = 0;
+        p[1]  = 0;
+        p[2]  = 0;
+        p[3]  = 0;
+        p[4]  = 0;
+        p[5]  = 0;
+        p[6]  = 0;
+        p[7]  = 0;
+        p    += 8;
+    }
+    return;
+}
+
+void PMM::zero_drain(void) {
+    while (zero_count > 0) {
+        zero_count--;
+        allocator_free(zero_pool[zero_count], 1);
+    }
+    return;
+}
+
+void PMM::allocator_free(uintptr_t _addr, size_t _len) {
+    // 判断应该使用哪个分配器
+    if (_addr >= kernel_space_start
+        && _addr < kernel_space_start + kernel_space_length) {
+        kernel_space_allocator->free(_addr, _len);
+        return;
+    }
+    region_t* region = find_region(_addr);
+    if (region != nullptr) {
+        region->allocator->free(_addr, _len);
+    }
+    // 如果都不是说明有问题
+    else {
+        assert(0);
+    }
+    return;
+}
+
 // 将启动信息移动到内核空间
 void PMM::move_boot_info(void) {
     // 计算 multiboot2 信息需要多少页
@@ -29,11 +496,12 @@ void PMM::move_boot_info(void) {
     if (BOOT_INFO::boot_info_size % COMMON::PAGE_SIZE != 0) {
         pages++;
     }
-    // 申请空间
-    uintptr_t new_addr = get_instance().alloc_pages_kernel(pages);
+    // 申请空间，放在内核结束后
+    uintptr_t new_addr = early_alloc(pages * COMMON::PAGE_SIZE);
     // 复制过来，完成后以前的内存就可以使用了
-    memcpy((void*)new_addr, (void*)BOOT_INFO::boot_info_addr,
-           pages * COMMON::PAGE_SIZE);
+    // bootloader 可能将启动信息放在紧邻内核结束的位置，与新地址重叠
+    memmove((void*)new_addr, (void*)BOOT_INFO::boot_info_addr,
+            BOOT_INFO::boot_info_size);
     // 设置地址
     BOOT_INFO::boot_info_addr = (uintptr_t)new_addr;
     // 重新初始化
@@ -48,45 +516,70 @@ PMM& PMM::get_instance(void) {
 }
 
 bool PMM::init(void) {
-    // 获取物理内存信息
-    resource_t mem_info = BOOT_INFO::get_memory();
-    // 设置物理地址的起点与长度
-    start               = mem_info.mem.addr;
-    length              = mem_info.mem.len;
-    // 计算页数
-    total_pages         = length / COMMON::PAGE_SIZE;
     // 内核空间地址开始
     kernel_space_start  = COMMON::KERNEL_START_ADDR;
     // 长度手动指定
-    kernel_space_length = COMMON::KERNEL_SPACE_SIZE;
-    // 非内核空间在内核空间结束后
-    non_kernel_space_start
-      = COMMON::KERNEL_START_ADDR + COMMON::KERNEL_SPACE_SIZE;
-    // 长度为总长度减去内核长度
-    non_kernel_space_length = length - kernel_space_length;
+    kernel_space_length = KERNEL_ZONE_SIZE;
+
+    // 启动阶段的内存从内核结束后开始
+    early_end = COMMON::ALIGN(COMMON::KERNEL_END_ADDR, COMMON::PAGE_SIZE);
+    // 将 multiboot2/dtb 信息移动到内核空间
+    // 需要在分配器之前进行，避免元数据覆盖启动信息
+    move_boot_info();
+
+    // 计算内存区域
+    find_regions();
+    // 保留连续内存
+    reserve_cma();
+    // 从区域中划出页描述符与分配器元数据
+    init_pages();
+    // 非内核空间由所有区域组成
+    non_kernel_space_start  = region_count > 0 ? regions[0].start : 0;
+    non_kernel_space_length = 0;
+    for (size_t i = 0; i < region_count; i++) {
+        non_kernel_space_length += regions[i].length;
+    }
+    non_kernel_space_length += cma.length;
+    // 设置物理地址的起点与长度
+    start = kernel_space_start;
+    if ((region_count > 0) && (regions[0].start < start)) {
+        start = regions[0].start;
+    }
+    length      = kernel_space_length + non_kernel_space_length;
+    // 计算页数
+    total_pages = length / COMMON::PAGE_SIZE;
 
     // 创建分配器
     // 内核空间
-    static FIRSTFIT first_fit_allocator_kernel(
-      "First Fit Allocator(kernel space)", kernel_space_start,
-      kernel_space_length / COMMON::PAGE_SIZE);
-    kernel_space_allocator = (ALLOCATOR*)&first_fit_allocator_kernel;
-    // 非内核空间
-    static FIRSTFIT first_fit_allocator("First Fit Allocator",
-                                        non_kernel_space_start,
-                                        non_kernel_space_length
-                                          / COMMON::PAGE_SIZE);
-    allocator = (ALLOCATOR*)&first_fit_allocator;
-
-    // 内核实际占用页数 这里也算了 0～1M 的 reserved 内存
+    kernel_space_allocator
+      = create_allocator(true, kernel_space_start,
+                         kernel_space_length / COMMON::PAGE_SIZE);
+    // 非内核空间，每个区域一个
+    for (size_t i = 0; i < region_count; i++) {
+        regions[i].allocator
+          = create_allocator(false, regions[i].start,
+                             regions[i].length / COMMON::PAGE_SIZE);
+    }
+    if (cma.length != 0) {
+        cma.allocator = create_allocator(false, cma.start,
+                                         cma.length / COMMON::PAGE_SIZE);
+    }
+    // 计算 zone 的水位
+    init_zones();
+
+    // 内核、启动信息与分配器元数据实际占用页数
     size_t kernel_pages
-      = (COMMON::ALIGN(COMMON::KERNEL_END_ADDR, COMMON::PAGE_SIZE)
+      = (COMMON::ALIGN(early_end, COMMON::PAGE_SIZE)
          - COMMON::ALIGN(COMMON::KERNEL_START_ADDR, COMMON::PAGE_SIZE))
       / COMMON::PAGE_SIZE;
     // 将内核已使用部分划分出来
     if (alloc_pages_kernel(COMMON::KERNEL_START_ADDR, kernel_pages) == true) {
-        // 将 multiboot2/dtb 信息移动到内核空间
-        move_boot_info();
+        early_end = COMMON::ALIGN(early_end, COMMON::PAGE_SIZE);
+        // 这部分内存不会被释放
+        page_t* page = addr_to_page(COMMON::KERNEL_START_ADDR);
+        for (size_t i = 0; i < kernel_pages; i++) {
+            page[i].flags |= page_t::RESERVED;
+        }
         info("pmm init.\n");
         return true;
     }
@@ -100,6 +593,18 @@ size_t PMM::get_pmm_length(void) const {
     return length;
 }
 
+uintptr_t PMM::get_pmm_start(void) const {
+    return page_to_addr(pages);
+}
+
+uintptr_t PMM::get_pmm_end(void) const {
+    return page_to_addr(pages + pages_count);
+}
+
+uintptr_t PMM::get_early_end(void) const {
+    return early_end;
+}
+
 uintptr_t PMM::get_kernel_space_start(void) const {
     return kernel_space_start;
 }
@@ -117,77 +622,302 @@ size_t PMM::get_non_kernel_space_length(void) const {
 }
 
 size_t PMM::get_used_pages_count(void) const {
-    size_t ret
-      = kernel_space_allocator->get_used_count() + allocator->get_used_count();
-    return ret;
+    size_t ret = kernel_space_allocator->get_used_count();
+    for (size_t i = 0; i < region_count; i++) {
+        ret += regions[i].allocator->get_used_count();
+    }
+    if (cma.allocator != nullptr) {
+        ret += cma.allocator->get_used_count();
+    }
+    // 页缓存与预先清零的页视为空闲
+    return ret - get_pcp_count() - zero_count;
 }
 
 size_t PMM::get_free_pages_count(void) const {
-    size_t ret
-      = kernel_space_allocator->get_free_count() + allocator->get_free_count();
+    size_t ret = kernel_space_allocator->get_free_count();
+    for (size_t i = 0; i < region_count; i++) {
+        ret += regions[i].allocator->get_free_count();
+    }
+    if (cma.allocator != nullptr) {
+        ret += cma.allocator->get_free_count();
+    }
+    return ret + get_pcp_count() + zero_count;
+}
+
+size_t PMM::get_free_blocks(size_t* _hist, size_t _orders) const {
+    // 最多 REGION_MAX 个区域，加上内核空间与 cma
+    const ALLOCATOR* allocators[REGION_MAX + 2];
+    size_t           count = 0;
+    allocators[count++]    = kernel_space_allocator;
+    for (size_t i = 0; i < region_count; i++) {
+        allocators[count++] = regions[i].allocator;
+    }
+    if (cma.allocator != nullptr) {
+        allocators[count++] = cma.allocator;
+    }
+    // 页数不会超过 2^(字长)
+    size_t hist[sizeof(size_t) * 8];
+    size_t ret = 0;
+    assert(_orders <= sizeof(hist) / sizeof(hist[0]));
+    for (size_t i = 0; i < _orders; i++) {
+        _hist[i] = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t largest = allocators[i]->get_free_blocks(hist, _orders);
+        for (size_t j = 0; j < _orders; j++) {
+            _hist[j] += hist[j];
+        }
+        if (largest > ret) {
+            ret = largest;
+        }
+    }
     return ret;
 }
 
 uintptr_t PMM::alloc_page(void) {
-    uintptr_t ret = allocator->alloc(1);
+    uintptr_t ret = pcp_alloc(false);
+    if (ret != 0) {
+        set_pages(ret, 1, true);
+    }
     return ret;
 }
 
 uintptr_t PMM::alloc_pages(size_t _len) {
-    uintptr_t ret = allocator->alloc(_len);
+    uintptr_t ret = fallback_alloc(ZONE_NORMAL, _len, true);
+    if (ret != 0) {
+        set_pages(ret, _len, true);
+    }
+    return ret;
+}
+
+uintptr_t PMM::alloc_pages_zone(size_t _len, zone_type_t _zone) {
+    uintptr_t ret = fallback_alloc(_zone, _len, true);
+    if (ret != 0) {
+        set_pages(ret, _len, true);
+    }
+    return ret;
+}
+
+uintptr_t PMM::alloc_pages_aligned(size_t _len, size_t _align) {
+    assert((_align & (_align - 1)) == 0);
+    if (_align <= COMMON::PAGE_SIZE) {
+        return alloc_pages(_len);
+    }
+    uintptr_t ret = 0;
+    // 依次尝试每个区域，失败时归还页缓存后重试
+    for (size_t retry = 0; (retry < 2) && (ret == 0); retry++) {
+        if (retry != 0) {
+            drain_pcp();
+        }
+        for (size_t i = 0; (i < region_count) && (ret == 0); i++) {
+            ret = regions[i].allocator->alloc_aligned(_len, _align);
+        }
+    }
+    // 最后使用保留的连续内存
+    if ((ret == 0) && (cma.allocator != nullptr)) {
+        ret = cma.allocator->alloc_aligned(_len, _align);
+    }
+    if (ret != 0) {
+        set_pages(ret, _len, true);
+    }
     return ret;
 }
 
 bool PMM::alloc_pages(uintptr_t _addr, size_t _len) {
-    bool ret = allocator->alloc(_addr, _len);
+    region_t* region = find_region(_addr);
+    // 不在任何区域内
+    if (region == nullptr) {
+        return false;
+    }
+    bool ret = region->allocator->alloc(_addr, _len);
+    // 可能有页在页缓存中，归还后重试
+    if (ret == false) {
+        drain_pcp();
+        ret = region->allocator->alloc(_addr, _len);
+    }
+    if (ret == true) {
+        set_pages(_addr, _len, true);
+    }
     return ret;
 }
 
 uintptr_t PMM::alloc_page_kernel(void) {
-    uintptr_t ret = kernel_space_allocator->alloc(1);
+    uintptr_t ret = pcp_alloc(true);
+    if (ret != 0) {
+        set_pages(ret, 1, true);
+    }
+    return ret;
+}
+
+uintptr_t PMM::alloc_zeroed_page(void) {
+    uintptr_t ret = 0;
+    if (zero_count > 0) {
+        zero_count--;
+        ret = zero_pool[zero_count];
+    }
+    // 没有预先清零的页，当场清零
+    else {
+        ret = pcp_alloc(true);
+        if (ret == 0) {
+            return 0;
+        }
+        clear_page(ret);
+    }
+    set_pages(ret, 1, true);
+    return ret;
+}
+
+size_t PMM::refill_zero_pool(void) {
+    size_t ret = 0;
+    // 内存紧张时不补充，避免与回收交替进行
+    size_t free = 0;
+    size_t high = 0;
+    for (size_t i = 0; i < ZONE_MAX; i++) {
+        free += zone_free_count((zone_type_t)i);
+        high += zones[i].high;
+    }
+    if (free < high + ZERO_POOL_SIZE) {
+        return ret;
+    }
+    while (zero_count < ZERO_POOL_SIZE) {
+        uintptr_t addr = pcp_alloc(true);
+        if (addr == 0) {
+            break;
+        }
+        clear_page(addr);
+        // 清零完成后再放入
+        zero_pool[zero_count] = addr;
+        zero_count++;
+        ret++;
+    }
     return ret;
 }
 
+size_t PMM::get_zero_pool_count(void) const {
+    return zero_count;
+}
+
 uintptr_t PMM::alloc_pages_kernel(size_t _len) {
-    uintptr_t ret = kernel_space_allocator->alloc(_len);
+    uintptr_t ret = fallback_alloc(ZONE_KERNEL, _len, true);
+    if (ret != 0) {
+        set_pages(ret, _len, true);
+    }
     return ret;
 }
 
 bool PMM::alloc_pages_kernel(uintptr_t _addr, size_t _len) {
     bool ret = kernel_space_allocator->alloc(_addr, _len);
+    if (ret == false) {
+        drain_pcp();
+        zero_drain();
+        ret = kernel_space_allocator->alloc(_addr, _len);
+    }
+    if (ret == true) {
+        set_pages(_addr, _len, true);
+    }
     return ret;
 }
 
 void PMM::free_page(uintptr_t _addr) {
-    // 判断应该使用哪个分配器
-    if (_addr >= kernel_space_start
-        && _addr < kernel_space_start + kernel_space_length) {
-        kernel_space_allocator->free(_addr, 1);
-    }
-    else if (_addr >= non_kernel_space_start
-             && _addr < non_kernel_space_start + non_kernel_space_length) {
-        allocator->free(_addr, 1);
-    }
-    else {
-        // 如果都不是说明有问题
-        assert(0);
-    }
+    set_pages(_addr, 1, false);
+    pcp_free(_addr, true);
+    return;
+}
+
+void PMM::free_page_cold(uintptr_t _addr) {
+    set_pages(_addr, 1, false);
+    pcp_free(_addr, false);
     return;
 }
 
 void PMM::free_pages(uintptr_t _addr, size_t _len) {
-    // 判断应该使用哪个分配器
-    if (_addr >= kernel_space_start
-        && _addr < kernel_space_start + kernel_space_length) {
-        kernel_space_allocator->free(_addr, _len);
+    set_pages(_addr, _len, false);
+    allocator_free(_addr, _len);
+    return;
+}
+
+void PMM::drain_pcp(void) {
+    pcp_t* cache = get_pcp(false);
+    pcp_drain(cache, cache->count);
+    cache = get_pcp(true);
+    pcp_drain(cache, cache->count);
+    return;
+}
+
+PMM::pcp_stat_t PMM::get_pcp_stat(void) const {
+    pcp_stat_t ret = {0, 0, 0, 0};
+    for (size_t i = 0; i < COMMON::CPU_MAX; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            ret.alloc  += pcp[i][j].stat.alloc;
+            ret.hit    += pcp[i][j].stat.hit;
+            ret.refill += pcp[i][j].stat.refill;
+            ret.drain  += pcp[i][j].stat.drain;
+        }
     }
-    else if (_addr >= non_kernel_space_start
-             && _addr < non_kernel_space_start + non_kernel_space_length) {
-        allocator->free(_addr, _len);
+    return ret;
+}
+
+void PMM::get_page(uintptr_t _addr) {
+    page_t* page = addr_to_page(_addr);
+    assert((page != nullptr) && (page->ref != 0));
+    page->ref++;
+    return;
+}
+
+bool PMM::put_page(uintptr_t _addr) {
+    page_t* page = addr_to_page(_addr);
+    // 只支持单页
+    assert((page != nullptr) && (page->ref != 0) && (page->order == 0));
+    page->ref--;
+    if (page->ref == 0) {
+        free_page(_addr);
+        return true;
     }
-    // 如果都不是说明有问题
-    else {
-        assert(0);
+    return false;
+}
+
+size_t PMM::get_zone_free_count(zone_type_t _zone) const {
+    return zone_free_count(_zone);
+}
+
+bool PMM::register_shrinker(shrinker_t _shrinker) {
+    if (shrinker_count == SHRINKER_MAX) {
+        return false;
     }
-    return;
+    shrinkers[shrinker_count] = _shrinker;
+    shrinker_count++;
+    return true;
+}
+
+size_t PMM::reclaim(size_t _pages) {
+    size_t before = get_free_pages_count() - get_pcp_count() - zero_count;
+    // 页缓存与预先清零的页可以直接归还
+    drain_pcp();
+    zero_drain();
+    size_t ret = get_free_pages_count() - before;
+    for (size_t i = 0; (i < shrinker_count) && (ret < _pages); i++) {
+        ret += shrinkers[i](_pages - ret);
+    }
+    return ret;
+}
+
+size_t PMM::balance_zones(void) {
+    size_t ret = 0;
+    for (size_t i = 0; i < ZONE_MAX; i++) {
+        size_t free = zone_free_count((zone_type_t)i);
+        // 回到高水位后重新允许请求
+        if (free >= zones[i].high) {
+            zones[i].hold = false;
+        }
+        if (zones[i].pending == false) {
+            continue;
+        }
+        zones[i].pending = false;
+        if (free < zones[i].high) {
+            ret += reclaim(zones[i].high - free);
+        }
+        // 回收不到高水位时，避免每次分配都重复回收
+        zones[i].hold = zone_free_count((zone_type_t)i) < zones[i].high;
+    }
+    return ret;
 }
@@ -22,10 +22,12 @@
 #include "vmm.h"
 
 SLAB::chunk_t::chunk_t(void) {
-    addr = HEAD;
-    len  = HEAD;
-    prev = this;
-    next = this;
+    addr      = HEAD;
+    len       = HEAD;
+    prev      = this;
+    next      = this;
+    phys_prev = nullptr;
+    phys_next = nullptr;
     return;
 }
 
@@ -84,22 +86,22 @@ void SLAB::chunk_t::push_back(chunk_t* _new_node) {
     return;
 }
 
-void SLAB::slab_cache_t::move(chunk_t& _list, chunk_t* _node) {
-    // 从当前链表中删除
-    _node->prev->next = _node->next;
-    _node->next->prev = _node->prev;
-    // 重置指针
-    _node->prev       = _node;
-    _node->next       = _node;
-    // 插入新链表
-    _list.push_back(_node);
+void SLAB::chunk_t::unlink(void) {
+    prev->next = next;
+    next->prev = prev;
+    prev       = nullptr;
+    next       = nullptr;
     return;
 }
 
+bool SLAB::chunk_t::is_free(void) const {
+    return prev != nullptr;
+}
+
 SLAB::chunk_t* SLAB::slab_cache_t::alloc_pmm(size_t _len) {
-    // 计算页数
-    size_t pages = _len / COMMON::PAGE_SIZE;
-    if (_len % COMMON::PAGE_SIZE != 0) {
+    // 计算页数，需要包括 chunk_t 本身
+    size_t pages = (_len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
+    if ((_len + CHUNK_SIZE) % COMMON::PAGE_SIZE != 0) {
         pages += 1;
     }
     // 申请
@@ -110,75 +112,45 @@ SLAB::chunk_t* SLAB::slab_cache_t::alloc_pmm(size_t _len) {
     else {
         new_node = (chunk_t*)PMM::get_instance().alloc_pages(pages);
     }
-    // 如果没有映射则进行映射
-    uintptr_t tmp = 0;
-    for (size_t i = 0; i < pages; i++) {
-        // 地址=初始地址+页数偏移
-        tmp = (uintptr_t)((uint8_t*)new_node + i * COMMON::PAGE_SIZE);
-        if ((VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(), tmp, 0)
-             == false)
-            || (is_kernel_space)) {
-            if (is_kernel_space == true) {
-                VMM::get_instance().mmap(VMM::get_instance().get_pgd(),
-                                         (uintptr_t)new_node,
-                                         (uintptr_t)new_node,
-                                         VMM_PAGE_READABLE | VMM_PAGE_WRITABLE);
-            }
-            else {
-                VMM::get_instance().mmap(VMM::get_instance().get_pgd(),
-                                         (uintptr_t)new_node,
-                                         (uintptr_t)new_node,
-                                         VMM_PAGE_READABLE | VMM_PAGE_WRITABLE
-                                           | VMM_PAGE_USER);
-            }
-        }
-        // 已经映射的情况是不应该出现的
-        else {
-            assert(0);
-        }
-    }
     // 不为空的话进行初始化
     if (new_node != nullptr) {
+        // 物理内存已经被直接映射，内核空间可以直接使用
+        // 非内核空间需要允许用户访问，一次映射整个范围
+        if (is_kernel_space == false) {
+            VMM::get_instance().mmap_range(
+              VMM::get_instance().get_pgd(), (uintptr_t)new_node,
+              (uintptr_t)new_node, pages * COMMON::PAGE_SIZE,
+              VMM_PAGE_READABLE | VMM_PAGE_WRITABLE | VMM_PAGE_USER);
+        }
         // 初始化
         // 自身的地址
-        new_node->addr = (uintptr_t)new_node;
+        new_node->addr      = (uintptr_t)new_node;
         // 长度需要减去 chunk_t 的长度
-        new_node->len  = (pages * COMMON::PAGE_SIZE) - CHUNK_SIZE;
-        // 链表指针
-        new_node->prev = new_node;
-        new_node->next = new_node;
-        // 加入 free 链表
-        free.push_back(new_node);
+        new_node->len       = (pages * COMMON::PAGE_SIZE) - CHUNK_SIZE;
+        // 不在任何链表中
+        new_node->prev      = nullptr;
+        new_node->next      = nullptr;
+        // 一整段内存只有这一个块
+        new_node->phys_prev = nullptr;
+        new_node->phys_next = nullptr;
     }
     return new_node;
 }
 
-void SLAB::slab_cache_t::free_pmm(void) {
-    size_t   pages = 0;
-    // 遍历 free 链表
-    chunk_t* tmp   = free.next;
-    while (tmp != &free) {
-        pages = (tmp->len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
-        // 必须是整数个页
-        assert(((tmp->len + CHUNK_SIZE) % COMMON::PAGE_SIZE) == 0);
-        PMM::get_instance().free_pages(tmp->addr, pages);
-        // 删除节点
-        tmp->prev->next    = tmp->next;
-        tmp->next->prev    = tmp->prev;
-        // 取消映射后无法访问 tmp，所以提前保存
-        auto      tmp_next = tmp->next;
-        // 取消映射
-        // 因为每次只能取消映射 1 页，所以需要循环
-        uintptr_t tmp_addr = 0;
-        for (size_t i = 0; i < pages; i++) {
-            tmp_addr = tmp->addr + i * COMMON::PAGE_SIZE;
-            VMM::get_instance().unmmap(VMM::get_instance().get_pgd(), tmp_addr);
-        }
-        // 迭代
-        tmp = tmp_next;
+void SLAB::slab_cache_t::free_pmm(chunk_t* _node) {
+    size_t pages = (_node->len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
+    // 必须是整数个页
+    assert(((_node->len + CHUNK_SIZE) % COMMON::PAGE_SIZE) == 0);
+    assert((_node->phys_prev == nullptr) && (_node->phys_next == nullptr));
+    // 物理内存需要保持直接映射，不能取消映射
+    // 非内核空间恢复为直接映射的属性
+    if (is_kernel_space == false) {
+        VMM::get_instance().mmap_range(VMM::get_instance().get_pgd(),
+                                       _node->addr, _node->addr,
+                                       pages * COMMON::PAGE_SIZE,
+                                       VMM_PAGE_KERNEL);
     }
-    // 释放完后 free 链表项应该为 0
-    assert(free.size() == 0);
+    PMM::get_instance().free_pages(_node->addr, pages);
     return;
 }
 
@@ -187,132 +159,135 @@ void SLAB::slab_cache_t::split(chunk_t* _node, size_t _len) {
     size_t old_len = _node->len;
     // 更新旧节点
     _node->len     = _len;
-    // 旧节点移动到 full
-    move(full, _node);
     // 原长度大于要分配的长度+新 chunk 长度
     // 不能等于，等于的话相当于新节点的 len 为 0
+    // 剩余部分不足时留在 _node 的末尾，释放时根据相邻块的地址找回
     if (old_len > _len + CHUNK_SIZE) {
         // 处理新节点
         // 新节点地址为原本地址+chunk大小+要分配出去的长度
-        chunk_t* new_node = (chunk_t*)(_node->addr + CHUNK_SIZE + _len);
-        new_node->addr    = (uintptr_t)new_node;
+        chunk_t* new_node   = (chunk_t*)(_node->addr + CHUNK_SIZE + _len);
+        new_node->addr      = (uintptr_t)new_node;
         // 剩余长度为原本的长度减去要分配给 _node 的长度，减去新节点的 chunk
         // 大小
-        new_node->len     = old_len - _len - CHUNK_SIZE;
-        // 手动初始化节点
-        new_node->prev    = new_node;
-        new_node->next    = new_node;
-        // 判断剩余空间是否可以容纳至少一个节点，即大于等于  len+CHUNK_SIZE
-        // 如果大于等于则建立新的节点，小于的话不用新建
-        // 这里只有 len 是因为 chunk 的大小并不包括在 chunk->len
-        // 中， 前面几行代码已经计算过了
-        if (new_node->len > len) {
-            // 新的节点必然属于 part 链表
-            part.push_back(new_node);
+        new_node->len       = old_len - _len - CHUNK_SIZE;
+        // 插入到 _node 与其后一个块之间
+        new_node->phys_prev = _node;
+        new_node->phys_next = _node->phys_next;
+        if (_node->phys_next != nullptr) {
+            _node->phys_next->phys_prev = new_node;
         }
+        _node->phys_next = new_node;
+        // 新的节点必然属于 part 链表
+        part.push_back(new_node);
     }
     return;
 }
 
-// TODO: 优化算法
-void SLAB::slab_cache_t::merge(void) {
-    // 如果节点少于两个，不需要合并
-    if (part.size() < 2) {
-        return;
+SLAB::chunk_t* SLAB::slab_cache_t::merge(chunk_t* _node) {
+    // 恢复为到下一个块为止的长度，包括分割时留下的剩余部分
+    // 最后一块延伸到所在内存段的末尾，即页边界
+    if (_node->phys_next != nullptr) {
+        _node->len = _node->phys_next->addr - _node->addr - CHUNK_SIZE;
     }
-    // 合并的条件
-    // node1->addr+CHUNK_SIZE+node1->len==node2->addr
-    // 暴力遍历
-    chunk_t* chunk = part.next;
-    chunk_t* tmp   = chunk->next;
-    // 外层循环
-    while (chunk != &part) {
-        // 内层循环
-        while (chunk != tmp) {
-            // 如果符合条件
-            if (chunk->addr + CHUNK_SIZE + chunk->len == tmp->addr) {
-                // 进行合并
-                // 加上 tmp 的 chunk 长度
-                chunk->len      += CHUNK_SIZE;
-                // 加上 tmp 的 len 长度
-                chunk->len      += tmp->len;
-                // 删除 tmp
-                tmp->prev->next  = tmp->next;
-                tmp->next->prev  = tmp->prev;
-                break;
-            }
-            tmp = tmp->next;
-        }
-        chunk = chunk->next;
+    else {
+        _node->len = COMMON::ALIGN(_node->addr + CHUNK_SIZE + _node->len,
+                                   COMMON::PAGE_SIZE)
+                   - _node->addr - CHUNK_SIZE;
     }
-
-    // 遍历查找可以移动到 free 链表的
-    // 如果 part 长度等于 len-chunnk 大小
-    tmp = part.next;
-    while (tmp != &part) {
-        // 节点 len + chunk 长度对页大小取余，如果为零说明有整数页没有被使用
-        if (((tmp->len + CHUNK_SIZE) % COMMON::PAGE_SIZE) == 0) {
-            // 移动到 free
-            move(free, tmp);
-            // 因为 tmp 已经被修改了，所以重新赋值
-            tmp = part.next;
+    // 合并后一个块
+    chunk_t* next = _node->phys_next;
+    if ((next != nullptr) && (next->is_free() == true)) {
+        next->unlink();
+        _node->len       += CHUNK_SIZE + next->len;
+        _node->phys_next  = next->phys_next;
+        if (next->phys_next != nullptr) {
+            next->phys_next->phys_prev = _node;
         }
-        else {
-            // 没有被修改，直接指向 next
-            tmp = tmp->next;
+    }
+    // 合并到前一个块
+    chunk_t* prev = _node->phys_prev;
+    if ((prev != nullptr) && (prev->is_free() == true)) {
+        prev->unlink();
+        prev->len       += CHUNK_SIZE + _node->len;
+        prev->phys_next  = _node->phys_next;
+        if (_node->phys_next != nullptr) {
+            _node->phys_next->phys_prev = prev;
         }
+        _node = prev;
     }
-    // 寻找可以释放的节点进行释放
-    free_pmm();
-    return;
+    return _node;
 }
 
-SLAB::chunk_t*
-SLAB::slab_cache_t::find(chunk_t& _which, size_t _len, bool _alloc) {
-    chunk_t* res = nullptr;
+SLAB::chunk_t* SLAB::slab_cache_t::find(chunk_t& _which, size_t _len) {
     // 在 _which 中查找，直接遍历即可
     chunk_t* tmp = _which.next;
     while (tmp != &_which) {
         // 如果 tmp 节点的长度大于等于 _len
         if (tmp->len >= _len) {
-            // 更新 res
-            res = tmp;
-            // 跳出循环
-            break;
+            return tmp;
         }
         tmp = tmp->next;
     }
-    // 如果 res 为空，说明在 _which 链表中没有找到合适的节点
-    // 如果同时 _alloc 成立
-    if (res == nullptr && _alloc == true) {
-        // 申请新的空间
-        res = alloc_pmm(_len);
-    }
-    // 如果 res 不为空
-    if (res != nullptr) {
-        // 对 res 进行切割，res 加入 full，剩余部分进入 part
-        split(res, _len);
+    return nullptr;
+}
+
+size_t SLAB::slab_cache_t::trim(size_t _pages) {
+    size_t ret = 0;
+    // 从最早放入的开始归还
+    while ((free_pages > _pages) && (free.next != &free)) {
+        chunk_t* tmp    = free.next;
+        size_t   pages  = (tmp->len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
+        tmp->unlink();
+        free_pmm(tmp);
+        free_pages     -= pages;
+        ret            += pages;
     }
-    return res;
+    return ret;
 }
 
 SLAB::chunk_t* SLAB::slab_cache_t::find(size_t _len) {
-    chunk_t* chunk = nullptr;
-    // 在 part 里找，如果没有找到允许申请新的空间
-    chunk          = find(part, _len, true);
+    // 首先在 part 里找，然后是 free，都没有时申请新的空间
+    chunk_t* chunk = find(part, _len);
+    if (chunk == nullptr) {
+        chunk = find(free, _len);
+        if (chunk != nullptr) {
+            free_pages -= (chunk->len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
+        }
+    }
+    if (chunk != nullptr) {
+        chunk->unlink();
+    }
+    else {
+        chunk = alloc_pmm(_len);
+    }
     // 如果到这里 chunk 还为 nullptr 说明空间不够了
     assert(chunk != nullptr);
+    // 对 chunk 进行切割，剩余部分进入 part
+    split(chunk, _len);
     return chunk;
 }
 
 void SLAB::slab_cache_t::remove(chunk_t* _node) {
-    // 将 _node 移动到 part 即可
-    move(part, _node);
-    // merge 会处理节点合并的情况
-    merge();
+    chunk_t* chunk = merge(_node);
+    // 整段内存都空闲时放入 free，不立即归还，避免反复申请
+    if ((chunk->phys_prev == nullptr) && (chunk->phys_next == nullptr)) {
+        free.push_back(chunk);
+        free_pages += (chunk->len + CHUNK_SIZE) / COMMON::PAGE_SIZE;
+        // 超过高水位时归还到低水位
+        if (free_pages > TRIM_HIGH) {
+            trim(TRIM_LOW);
+        }
+    }
+    else {
+        part.push_back(chunk);
+    }
     return;
 }
 
+size_t SLAB::slab_cache_t::shrink(void) {
+    return trim(0);
+}
+
 size_t SLAB::get_idx(size_t _len) const {
     size_t res  = 0;
     // _len 向上取整
@@ -338,8 +313,9 @@ size_t SLAB::get_idx(size_t _len) const {
 SLAB::SLAB(const char* _name, uintptr_t _addr, size_t _len, bool _is_kernel)
     : ALLOCATOR(_name, _addr, _len), is_kernel_space(_is_kernel) {
     // 初始化 slab_cache
-    for (size_t i = LEN256; i < LEN65536; i++) {
+    for (size_t i = LEN256; i < CACHAE_LEN; i++) {
         slab_cache[i].len             = MIN << i;
+        slab_cache[i].free_pages      = 0;
         slab_cache[i].is_kernel_space = _is_kernel;
     }
     info("%s: 0x%p(0x%p bytes) init.\n", name, allocator_start_addr,
@@ -397,11 +373,12 @@ void SLAB::free(uintptr_t _addr, size_t) {
     // 1. 计算 chunk 地址
     chunk_t* chunk = (chunk_t*)(_addr - CHUNK_SIZE);
     assert((uintptr_t)chunk == chunk->addr);
+    assert(chunk->is_free() == false);
     // 2. 计算所属 slab_cache 索引
     auto a = chunk->len;
     assert(chunk->len != 0);
     auto idx = get_idx(chunk->len);
-    // 3. 调用对应的 remove 函数
+    // 3. 调用对应的 remove 函数，与相邻的空闲块合并
     slab_cache[idx].remove(chunk);
 // #define DEBUG
 #ifdef DEBUG
@@ -414,6 +391,14 @@ void SLAB::free(uintptr_t _addr, size_t) {
     return;
 }
 
+size_t SLAB::shrink(void) {
+    size_t ret = 0;
+    for (size_t i = 0; i < CACHAE_LEN; i++) {
+        ret += slab_cache[i].shrink();
+    }
+    return ret;
+}
+
 size_t SLAB::get_used_count(void) const {
     return allocator_used_count;
 }
@@ -14,30 +14,34 @@
  * </table>
  */
 
+#include "alloc_bench.h"
+#include "buddy.h"
 #include "cassert"
 #include "common.h"
+#include "cpu.hpp"
 #include "cstdio"
 #include "cstdlib"
+#include "cstring"
+#include "firstfit.h"
 #include "heap.h"
 #include "kernel.h"
+#include "kmem_cache.h"
+#include "mm.h"
 #include "pmm.h"
 #include "vmm.h"
+#if defined(__i386__) || defined(__x86_64__)
+#    include "port.h"
+#endif
 
 int32_t test_pmm(void) {
     // 保存现有 pmm 空闲页数量
     size_t free_pages = PMM::get_instance().get_free_pages_count();
     // 计算内核实际占用页数
+    // 包括内核本身、启动信息与分配器元数据
     auto   kernel_pages
-      = (COMMON::ALIGN(COMMON::KERNEL_END_ADDR, COMMON::PAGE_SIZE)
+      = (PMM::get_instance().get_early_end()
          - COMMON::ALIGN(COMMON::KERNEL_START_ADDR, COMMON::PAGE_SIZE))
       / COMMON::PAGE_SIZE;
-    // 再加上启动信息使用的页，一般为一页
-    kernel_pages++;
-    // TODO: 替换宏
-    // riscv 的 dtb 占用空间比较大，两页
-#ifdef __riscv
-    kernel_pages++;
-#endif
     // 空闲页数应该等于物理内存大小-内核使用
     assert(free_pages
            == (PMM::get_instance().get_pmm_length() / COMMON::PAGE_SIZE)
@@ -69,6 +73,83 @@ int32_t test_pmm(void) {
     PMM::get_instance().free_pages(addr4, 100);
     // 现在内存使用情况应该与此函数开始时相同
     assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 逐页分配，经过页缓存
+    auto      stat = PMM::get_instance().get_pcp_stat();
+    uintptr_t pages[64];
+    for (auto i = 0; i < 64; i++) {
+        pages[i] = PMM::get_instance().alloc_page();
+        assert(pages[i] != 0);
+    }
+    // 页缓存为空，每 32 页补充一次
+    assert(PMM::get_instance().get_pcp_stat().alloc - stat.alloc == 64);
+    assert(PMM::get_instance().get_pcp_stat().refill - stat.refill == 2);
+    assert(PMM::get_instance().get_pcp_stat().hit - stat.hit == 62);
+    assert(PMM::get_instance().get_used_pages_count() == 64 + kernel_pages);
+    for (auto i = 0; i < 64; i++) {
+        PMM::get_instance().free_page(pages[i]);
+    }
+    // 页缓存中的页算作空闲
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 最后释放的页最先被使用
+    addr1 = PMM::get_instance().alloc_page();
+    assert(addr1 == pages[63]);
+    PMM::get_instance().free_page(addr1);
+    // 归还页缓存后，空闲块应该重新合并
+    PMM::get_instance().drain_pcp();
+    addr1 = PMM::get_instance().alloc_pages(64);
+    assert(addr1 != 0);
+    PMM::get_instance().free_pages(addr1, 64);
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 页描述符
+    addr1      = PMM::get_instance().alloc_page();
+    auto page1 = PMM::get_instance().addr_to_page(addr1);
+    assert(page1 != nullptr);
+    assert((page1->ref == 1) && (page1->flags == page_t::HEAD));
+    assert(PMM::get_instance().page_to_addr(page1) == addr1);
+    assert(PMM::get_instance().pfn_to_page(addr1 >> COMMON::PAGE_SHIFT)
+           == page1);
+    // 引用计数减为 0 时释放
+    PMM::get_instance().get_page(addr1);
+    assert(page1->ref == 2);
+    assert(PMM::get_instance().put_page(addr1) == false);
+    assert(PMM::get_instance().put_page(addr1) == true);
+    assert(page1->ref == 0);
+    // 块的大小记录在首页
+    addr1 = PMM::get_instance().alloc_pages(3);
+    page1 = PMM::get_instance().addr_to_page(addr1);
+    assert((page1->order == 2) && (page1[1].ref == 1) && (page1[2].ref == 1));
+    PMM::get_instance().free_pages(addr1, 3);
+    assert((page1->ref == 0) && (page1[2].ref == 0));
+    // 内核占用的页不会被分配
+    page1 = PMM::get_instance().addr_to_page(COMMON::KERNEL_START_ADDR);
+    assert((page1->flags & page_t::RESERVED) && (page1->ref == 1));
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 对齐分配
+    addr1 = PMM::get_instance().alloc_pages_aligned(1, 2 * COMMON::MB);
+    assert((addr1 != 0) && ((addr1 & (2 * COMMON::MB - 1)) == 0));
+    addr2 = PMM::get_instance().alloc_pages_aligned(513, 2 * COMMON::MB);
+    assert((addr2 != 0) && ((addr2 & (2 * COMMON::MB - 1)) == 0));
+    // 多分配的部分已经归还
+    assert(PMM::get_instance().get_used_pages_count() == 514 + kernel_pages);
+    PMM::get_instance().free_pages(addr1, 1);
+    PMM::get_instance().free_pages(addr2, 513);
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 预先清零的页
+    addr1 = PMM::get_instance().alloc_page_kernel();
+    memset((void*)addr1, 0xFF, COMMON::PAGE_SIZE);
+    PMM::get_instance().free_page(addr1);
+    auto zero_pages = PMM::get_instance().get_zero_pool_count();
+    assert(PMM::get_instance().refill_zero_pool() > 0);
+    assert(PMM::get_instance().get_zero_pool_count() > zero_pages);
+    // 清零的页算作空闲
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    zero_pages = PMM::get_instance().get_zero_pool_count();
+    addr1      = PMM::get_instance().alloc_zeroed_page();
+    assert(PMM::get_instance().get_zero_pool_count() == zero_pages - 1);
+    for (size_t i = 0; i < COMMON::PAGE_SIZE / sizeof(uintptr_t); i++) {
+        assert(((uintptr_t*)addr1)[i] == 0);
+    }
+    PMM::get_instance().free_page(addr1);
     // 下面测试内核空间物理内存分配
     // 已使用页数应该等于内核使用页数
     assert(used_pages == kernel_pages);
@@ -95,10 +176,271 @@ int32_t test_pmm(void) {
     PMM::get_instance().free_pages(addr4, 100);
     // 现在内存使用情况应该与此函数开始时相同
     assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 内核空间不足时从其它 zone 分配
+    auto kernel_end = PMM::get_instance().get_kernel_space_start()
+                    + PMM::get_instance().get_kernel_space_length();
+    auto len = PMM::get_instance().get_zone_free_count(PMM::ZONE_KERNEL);
+    addr1    = PMM::get_instance().alloc_pages_kernel(len);
+    assert((addr1 != 0) && (addr1 >= kernel_end));
+    PMM::get_instance().free_pages(addr1, len);
+    // DMA32 不会使用内核空间
+    addr1 = PMM::get_instance().alloc_pages_zone(1, PMM::ZONE_DMA32);
+    assert((addr1 != 0) && (addr1 >= kernel_end));
+    PMM::get_instance().free_pages(addr1, 1);
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // 内存充足时没有回收请求
+    assert(PMM::get_instance().balance_zones() == 0);
     info("pmm test done.\n");
     return 0;
 }
 
+/// 位图测试管理的页数，128MB
+static constexpr const size_t    BENCH_PAGES
+  = 128 * COMMON::MB / COMMON::PAGE_SIZE;
+/// 位图测试使用的地址，只用于计算，不会被访问
+static constexpr const uintptr_t BENCH_ADDR = 0x40000000;
+/// 每一位表示一页，逐位操作的对照位图
+static uintptr_t bench_map[BENCH_PAGES / (sizeof(uintptr_t) * 8)];
+
+/**
+ * @brief 逐位置位/清零对照位图中的 [_idx, _idx+_len)
+ * @param  _idx            起始索引
+ * @param  _len            位数
+ * @param  _val            值
+ */
+static void bench_set(size_t _idx, size_t _len, bool _val) {
+    for (auto i = _idx; i < _idx + _len; i++) {
+        if (_val) {
+            bench_map[i / (sizeof(uintptr_t) * 8)]
+              |= (uintptr_t)1 << (i % (sizeof(uintptr_t) * 8));
+        }
+        else {
+            bench_map[i / (sizeof(uintptr_t) * 8)]
+              &= ~((uintptr_t)1 << (i % (sizeof(uintptr_t) * 8)));
+        }
+    }
+    return;
+}
+
+/**
+ * @brief 逐位在对照位图中寻找连续 _len 个空闲位
+ * @param  _len            位数
+ * @return size_t          开始索引
+ */
+static size_t bench_find(size_t _len) {
+    size_t count = 0;
+    size_t idx   = 0;
+    for (size_t i = 0; i < BENCH_PAGES; i++) {
+        if (bench_map[i / (sizeof(uintptr_t) * 8)]
+            & ((uintptr_t)1 << (i % (sizeof(uintptr_t) * 8)))) {
+            count = 0;
+            idx   = i + 1;
+        }
+        else {
+            count++;
+        }
+        if (count == _len) {
+            return idx;
+        }
+    }
+    return ~(size_t)0;
+}
+
+int test_firstfit(void) {
+    // 位图从内核空间分配
+    size_t    meta_pages
+      = COMMON::ALIGN(FIRSTFIT::get_meta_size(BENCH_PAGES), COMMON::PAGE_SIZE)
+      / COMMON::PAGE_SIZE;
+    uintptr_t meta = PMM::get_instance().alloc_pages_kernel(meta_pages);
+    assert(meta != 0);
+    FIRSTFIT first_fit("First Fit Allocator(bench)", BENCH_ADDR, BENCH_PAGES,
+                       (void*)meta);
+    bzero(bench_map, sizeof(bench_map));
+    // 制造碎片: 前 3/4 的空间中每 8 页只留 1 页空闲
+    for (size_t i = 0; i < BENCH_PAGES / 4 * 3; i += 8) {
+        assert(first_fit.alloc(BENCH_ADDR + (i + 1) * COMMON::PAGE_SIZE, 7)
+               == true);
+        bench_set(i + 1, 7, true);
+    }
+    uint64_t  word_time = 0;
+    uint64_t  bit_time  = 0;
+    uint64_t  start     = 0;
+    uintptr_t addr      = 0;
+    size_t    idx       = 0;
+    for (size_t round = 0; round < 16; round++) {
+        // 需要跳过碎片区域才能找到的连续页
+        size_t len  = 2 + round * 8;
+        // 按字扫描
+        start       = CPU::READ_TIME();
+        addr        = first_fit.alloc(len);
+        first_fit.free(addr, len);
+        assert(first_fit.alloc(addr, 100) == true);
+        first_fit.free(addr, 100);
+        word_time += CPU::READ_TIME() - start;
+        // 逐位扫描
+        start      = CPU::READ_TIME();
+        idx        = bench_find(len);
+        bench_set(idx, len, true);
+        bench_set(idx, len, false);
+        bench_set(idx, 100, true);
+        bench_set(idx, 100, false);
+        bit_time += CPU::READ_TIME() - start;
+        // 两者结果应该相同
+        assert(addr == BENCH_ADDR + idx * COMMON::PAGE_SIZE);
+    }
+    assert(first_fit.get_used_count() == BENCH_PAGES / 8 / 4 * 3 * 7);
+    info("firstfit bench: word %lld, bit %lld (cycles).\n",
+         (long long)word_time, (long long)bit_time);
+    PMM::get_instance().free_pages(meta, meta_pages);
+    // 超过 128MB 的位图，1GB
+    size_t pages = 1 * COMMON::GB / COMMON::PAGE_SIZE;
+    meta_pages
+      = COMMON::ALIGN(FIRSTFIT::get_meta_size(pages), COMMON::PAGE_SIZE)
+      / COMMON::PAGE_SIZE;
+    meta = PMM::get_instance().alloc_pages_kernel(meta_pages);
+    assert(meta != 0);
+    FIRSTFIT first_fit_large("First Fit Allocator(1GB)", BENCH_ADDR, pages,
+                             (void*)meta);
+    // 只留下最后 3 页，查找时由摘要位图跳过已满的部分
+    assert(first_fit_large.alloc(BENCH_ADDR, pages - 3) == true);
+    addr = first_fit_large.alloc(3);
+    assert(addr == BENCH_ADDR + (pages - 3) * COMMON::PAGE_SIZE);
+    assert(first_fit_large.alloc(1) == 0);
+    first_fit_large.free(BENCH_ADDR, pages);
+    assert(first_fit_large.get_free_count() == pages);
+    PMM::get_instance().free_pages(meta, meta_pages);
+    info("firstfit test done.\n");
+    return 0;
+}
+
+/**
+ * @brief 获取 CPU::READ_TIME 的频率
+ * @return uint64_t        每秒的计数
+ * @note x86 使用 PIT 通道 2 校准 TSC
+ */
+static uint64_t time_freq(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    // PIT 频率
+    static constexpr const uint32_t PIT_FREQ = 1193182;
+    // 校准 10ms
+    static constexpr const uint32_t LATCH    = PIT_FREQ / 100;
+    // 打开通道 2 的门控，关闭扬声器
+    PORT::outb(0x61, (PORT::inb(0x61) & ~0x02) | 0x01);
+    // 通道 2，先低后高，模式 0
+    PORT::outb(0x43, 0xB0);
+    PORT::outb(0x42, LATCH & 0xFF);
+    PORT::outb(0x42, LATCH >> 8);
+    uint64_t start = CPU::READ_TIME();
+    // 计数结束时 OUT2 置位
+    while ((PORT::inb(0x61) & 0x20) == 0) {
+        ;
+    }
+    return (CPU::READ_TIME() - start) * 100;
+#elif defined(__riscv)
+    /// @todo 从 dts 读取 timebase-frequency
+    return 10000000;
+#endif
+}
+
+/**
+ * @brief 将 PMM 包装为 ALLOCATOR，单页经过页缓存
+ */
+class PMM_BENCH : ALLOCATOR {
+public:
+    PMM_BENCH(void) : ALLOCATOR("PMM", 0, 0) {
+        return;
+    }
+
+    ~PMM_BENCH(void) {
+        return;
+    }
+
+    uintptr_t alloc(size_t _len) override {
+        if (_len == 1) {
+            return PMM::get_instance().alloc_page();
+        }
+        return PMM::get_instance().alloc_pages(_len);
+    }
+
+    bool alloc(uintptr_t _addr, size_t _len) override {
+        return PMM::get_instance().alloc_pages(_addr, _len);
+    }
+
+    void free(uintptr_t _addr, size_t _len) override {
+        if (_len == 1) {
+            PMM::get_instance().free_page(_addr);
+        }
+        else {
+            PMM::get_instance().free_pages(_addr, _len);
+        }
+        return;
+    }
+
+    size_t get_used_count(void) const override {
+        return PMM::get_instance().get_used_pages_count();
+    }
+
+    size_t get_free_count(void) const override {
+        return PMM::get_instance().get_free_pages_count();
+    }
+
+    size_t get_free_blocks(size_t* _hist, size_t _orders) const override {
+        return PMM::get_instance().get_free_blocks(_hist, _orders);
+    }
+};
+
+/// 基准测试同时存在的最大分配数
+static constexpr const size_t BENCH_LIVE_MAX = 512;
+/// 基准测试的操作次数
+static constexpr const size_t BENCH_OPS      = 20000;
+/// 保存尚未释放的分配
+static ALLOC_BENCH::live_t    bench_live[BENCH_LIVE_MAX];
+
+int test_alloc_bench(void) {
+    uint64_t freq = time_freq();
+    info("time freq: %lld Hz.\n", (long long)freq);
+    // 与 test_firstfit 相同，分配器只计算地址，不访问被管理的内存
+    size_t    meta_len = BUDDY::get_meta_size(BENCH_PAGES);
+    if (FIRSTFIT::get_meta_size(BENCH_PAGES) > meta_len) {
+        meta_len = FIRSTFIT::get_meta_size(BENCH_PAGES);
+    }
+    size_t meta_pages
+      = COMMON::ALIGN(meta_len, COMMON::PAGE_SIZE) / COMMON::PAGE_SIZE;
+    uintptr_t meta = PMM::get_instance().alloc_pages_kernel(meta_pages);
+    assert(meta != 0);
+    {
+        BUDDY       buddy("Buddy Allocator(bench)", BENCH_ADDR, BENCH_PAGES,
+                          (void*)meta);
+        ALLOC_BENCH bench("buddy", (ALLOCATOR*)&buddy, bench_live,
+                          BENCH_LIVE_MAX, freq, 1);
+        bench.run(BENCH_OPS, BENCH_OPS / 4);
+        bench.free_all();
+        assert(((ALLOCATOR*)&buddy)->get_free_count() == BENCH_PAGES);
+    }
+    {
+        FIRSTFIT    first_fit("First Fit Allocator(bench)", BENCH_ADDR,
+                              BENCH_PAGES, (void*)meta);
+        ALLOC_BENCH bench("firstfit", (ALLOCATOR*)&first_fit, bench_live,
+                          BENCH_LIVE_MAX, freq, 1);
+        bench.run(BENCH_OPS, BENCH_OPS / 4);
+        bench.free_all();
+        assert(first_fit.get_free_count() == BENCH_PAGES);
+    }
+    PMM::get_instance().free_pages(meta, meta_pages);
+    // PMM，包括页缓存与 zone 回退
+    size_t free_pages = PMM::get_instance().get_free_pages_count();
+    {
+        PMM_BENCH   pmm;
+        ALLOC_BENCH bench("pmm", (ALLOCATOR*)&pmm, bench_live, BENCH_LIVE_MAX,
+                          freq, 1);
+        bench.run(BENCH_OPS, BENCH_OPS / 4);
+        bench.free_all();
+    }
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    info("alloc bench done.\n");
+    return 0;
+}
+
 /// @note riscv 内核模式下无法测试 VMM_PAGE_USER，默认状态下 S/U
 /// 模式的页无法互相访问
 /// @see
@@ -107,6 +449,11 @@ int32_t test_vmm(void) {
     uintptr_t addr = 0;
     // 首先确认内核空间被映射了
     assert(VMM::get_instance().get_pgd() != nullptr);
+    // 切换到同一个页目录，ASID 不变
+    size_t asid = VMM::get_instance().get_asid(VMM::get_instance().get_pgd());
+    VMM::get_instance().set_pgd(VMM::get_instance().get_pgd());
+    assert(VMM::get_instance().get_asid(VMM::get_instance().get_pgd())
+           == asid);
     assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
                                         (COMMON::KERNEL_START_ADDR + 0x1000),
                                         &addr)
@@ -121,25 +468,49 @@ int32_t test_vmm(void) {
     assert(addr
            == ((COMMON::KERNEL_START_ADDR + VMM_KERNEL_SPACE_SIZE - 1)
                & COMMON::PAGE_MASK));
+    // 内核空间之后的物理内存也被映射了
     addr = 0;
-    assert(VMM::get_instance().get_mmap(
-             VMM::get_instance().get_pgd(),
-             (COMMON::ALIGN(COMMON::KERNEL_START_ADDR, 4 * COMMON::KB)
-              + VMM_KERNEL_SPACE_SIZE),
-             &addr)
+    assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                        PMM::get_instance().get_pmm_end()
+                                          - COMMON::PAGE_SIZE,
+                                        &addr)
+           == 1);
+    assert(addr == PMM::get_instance().get_pmm_end() - COMMON::PAGE_SIZE);
+    addr = 0;
+    assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                        PMM::get_instance().get_pmm_end(),
+                                        &addr)
            == 0);
     assert(addr == 0);
     addr = 0;
+    assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                        PMM::get_instance().get_pmm_end()
+                                          + 0x1024,
+                                        0)
+           == 0);
+    // 所有物理内存都被直接映射
+    addr = 0;
     assert(VMM::get_instance().get_mmap(
              VMM::get_instance().get_pgd(),
-             (COMMON::ALIGN(COMMON::KERNEL_START_ADDR, 4 * COMMON::KB)
-              + VMM_KERNEL_SPACE_SIZE + 0x1024),
-             0)
-           == 0);
+             VMM_PA2VA(PMM::get_instance().get_pmm_start()), &addr)
+           == 1);
+    assert(addr == PMM::get_instance().get_pmm_start());
+    assert(VMM::get_instance().get_mmap(
+             VMM::get_instance().get_pgd(),
+             VMM_PA2VA(PMM::get_instance().get_pmm_end() - COMMON::PAGE_SIZE),
+             &addr)
+           == 1);
+    assert(addr == PMM::get_instance().get_pmm_end() - COMMON::PAGE_SIZE);
+    assert(VMM_IS_DIRECT(VMM_PA2VA(addr)) == true);
+    // 通过直接映射区写入，通过恒等映射读出
+    addr = PMM::get_instance().alloc_page();
+    *(uintptr_t*)VMM_PA2VA(addr) = 0x5A;
+    assert(*(uintptr_t*)addr == 0x5A);
+    PMM::get_instance().free_page(addr);
     // 测试映射与取消映射
     addr         = 0;
-    // 准备映射的虚拟地址 3GB 处
-    uintptr_t va = 0xC0000000;
+    // 准备映射的虚拟地址 1GB 处
+    uintptr_t va = 0x40000000;
     // 分配要映射的物理地址
     uintptr_t pa = PMM::get_instance().alloc_page_kernel();
     // 确定一块未映射的内存
@@ -163,6 +534,88 @@ int32_t test_vmm(void) {
     assert(addr == 0);
     // 回收物理地址
     PMM::get_instance().free_page(pa);
+    // 测试大页
+    if (VMM::get_instance().get_huge_level() > 0) {
+        // 第 1 级页表项映射的大小
+        size_t huge_pages = VMM_PAGES_PRE_PAGE_TABLE;
+        size_t huge_size  = huge_pages * COMMON::PAGE_SIZE;
+        pa = PMM::get_instance().alloc_pages_aligned(huge_pages, huge_size);
+        assert(pa != 0);
+        VMM::get_instance().mmap(VMM::get_instance().get_pgd(), va, pa,
+                                 VMM_PAGE_READABLE | VMM_PAGE_WRITABLE, 1);
+        assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                            va + 3 * COMMON::PAGE_SIZE, &addr)
+               == 1);
+        assert(addr == pa + 3 * COMMON::PAGE_SIZE);
+        *(uintptr_t*)(va + huge_size - sizeof(uintptr_t)) = 0xCD;
+        // 取消映射其中一页，大页会被拆分
+        VMM::get_instance().unmmap(VMM::get_instance().get_pgd(),
+                                   va + COMMON::PAGE_SIZE);
+        assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                            va + COMMON::PAGE_SIZE, nullptr)
+               == 0);
+        assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(), va,
+                                            &addr)
+               == 1);
+        assert(addr == pa);
+        assert(*(uintptr_t*)(va + huge_size - sizeof(uintptr_t)) == 0xCD);
+        // 取消其余的映射
+        for (size_t i = 0; i < huge_pages; i++) {
+            if (i != 1) {
+                VMM::get_instance().unmmap(VMM::get_instance().get_pgd(),
+                                           va + i * COMMON::PAGE_SIZE);
+            }
+        }
+        PMM::get_instance().free_pages(pa, huge_pages);
+    }
+    // 测试批量映射与取消映射，跨越页表的边界
+    size_t    range_pages = VMM_PAGES_PRE_PAGE_TABLE + 3;
+    uintptr_t range_va    = va + COMMON::PAGE_SIZE;
+    size_t    pt_pages    = VMM::get_instance().get_pt_pages();
+    pa = PMM::get_instance().alloc_pages(range_pages);
+    assert(pa != 0);
+    VMM::get_instance().mmap_range(VMM::get_instance().get_pgd(), range_va, pa,
+                                   range_pages * COMMON::PAGE_SIZE,
+                                   VMM_PAGE_READABLE | VMM_PAGE_WRITABLE);
+    assert(VMM::get_instance().get_pt_pages() > pt_pages);
+    for (size_t i = 0; i < range_pages; i += VMM_PAGES_PRE_PAGE_TABLE / 2) {
+        assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                            range_va + i * COMMON::PAGE_SIZE,
+                                            &addr)
+               == 1);
+        assert(addr == pa + i * COMMON::PAGE_SIZE);
+    }
+    assert(VMM::get_instance().get_mmap(
+             VMM::get_instance().get_pgd(),
+             range_va + (range_pages - 1) * COMMON::PAGE_SIZE, &addr)
+           == 1);
+    assert(addr == pa + (range_pages - 1) * COMMON::PAGE_SIZE);
+    assert(VMM::get_instance().get_mmap(
+             VMM::get_instance().get_pgd(),
+             range_va + range_pages * COMMON::PAGE_SIZE, nullptr)
+           == 0);
+    *(uintptr_t*)(range_va + range_pages * COMMON::PAGE_SIZE
+                  - sizeof(uintptr_t))
+      = 0xCD;
+    // 重新映射后不能访问到 TLB 中旧的映射
+    *(uintptr_t*)pa                       = 0x12;
+    *(uintptr_t*)(pa + COMMON::PAGE_SIZE) = 0x34;
+    assert(*(uintptr_t*)range_va == 0x12);
+    VMM::get_instance().mmap_range(VMM::get_instance().get_pgd(), range_va,
+                                   pa + COMMON::PAGE_SIZE, COMMON::PAGE_SIZE,
+                                   VMM_PAGE_READABLE | VMM_PAGE_WRITABLE);
+    assert(*(uintptr_t*)range_va == 0x34);
+    VMM::get_instance().unmap_range(VMM::get_instance().get_pgd(), range_va,
+                                    range_pages * COMMON::PAGE_SIZE);
+    for (size_t i = 0; i < range_pages; i++) {
+        assert(VMM::get_instance().get_mmap(VMM::get_instance().get_pgd(),
+                                            range_va + i * COMMON::PAGE_SIZE,
+                                            nullptr)
+               == 0);
+    }
+    // 变空的页表已经被释放
+    assert(VMM::get_instance().get_pt_pages() == pt_pages);
+    PMM::get_instance().free_pages(pa, range_pages);
     info("vmm test done.\n");
     return 0;
 }
@@ -172,49 +625,404 @@ int test_heap(void) {
     // 根据字长不同 CHUNK_SIZE 是不一样的
     size_t chunk_size = 0;
     if (sizeof(void*) == 4) {
-        chunk_size = 0x10;
+        chunk_size = 0x18;
     }
     else if (sizeof(void*) == 8) {
-        chunk_size = 0x20;
+        chunk_size = 0x30;
     }
     void* addr1 = nullptr;
     void* addr2 = nullptr;
     void* addr3 = nullptr;
     void* addr4 = nullptr;
-    // 申请超过最大允许的内存 65536B
-    addr1       = kmalloc(0x10001);
-    // 应该返回 nullptr
-    assert(addr1 == nullptr);
+    // 超过 SLAB 支持的 65536B 时直接分配整页
+    size_t free_pages = PMM::get_instance().get_free_pages_count();
+    addr1             = kmalloc(0x10001);
+    assert(addr1 != nullptr);
+    assert(((uintptr_t)addr1 & 0xFFF) == 0x0);
+    assert(kmem_cache_t::find(addr1) == nullptr);
+    memset(addr1, 0xA5, 0x10001);
+    addr2 = kmalloc(COMMON::MB);
+    assert(addr2 != nullptr);
+    memset(addr2, 0x5A, COMMON::MB);
+    assert(((uint8_t*)addr1)[0x10000] == 0xA5);
+    kfree(addr1);
+    kfree(addr2);
+    assert(PMM::get_instance().get_free_pages_count() == free_pages);
+    // malloc 由 SLAB 分配
     // 申请小块内存
-    addr2 = kmalloc(0x1);
+    addr2 = malloc(0x1);
     assert(addr2 != nullptr);
     // 第一块被申请的内存，减去 chunk 大小后应该是 4k 对齐的
     assert(((uintptr_t)((uint8_t*)addr2 - chunk_size) & 0xFFF) == 0x0);
     // 在 LEN512 申请新的内存
-    addr3 = kmalloc(0x200);
+    addr3 = malloc(0x200);
     assert(addr3 != nullptr);
     // 第一块被申请的内存，减去 chunk 大小后应该是 4k 对齐的
     assert(((uintptr_t)((uint8_t*)addr3 - chunk_size) & 0xFFF) == 0x0);
     // 加上 chunk 大小长度刚好是 LEN256
-    addr4 = kmalloc(0x80);
+    addr4 = malloc(0x80);
     assert(addr4 != nullptr);
     // LEN256 区域第二块被申请的内存，地址可以计算出来
     // 前一个块的地址+chunk 长度+数据长度+对齐长度
     assert(addr4 == (uint8_t*)addr2 + chunk_size + 0x1 + 0x7);
-    /// @bug 这里释放会同时 unmmap，导致后面的分支出现 pg
+    // 在 LEN1024 申请三块相邻的内存，剩余部分不足 0x400
+    void* addr5 = malloc(0x3F8);
+    void* addr6 = malloc(0x3F8);
+    void* addr7 = malloc(0x3F8);
+    assert(((uintptr_t)((uint8_t*)addr5 - chunk_size) & 0xFFF) == 0x0);
+    assert(addr6 == (uint8_t*)addr5 + chunk_size + 0x3F8);
+    assert(addr7 == (uint8_t*)addr6 + chunk_size + 0x3F8);
+    // 相邻的空闲块会被合并，可以分配更大的块
+    free(addr6);
+    free(addr5);
+    assert(malloc(0x400) == addr5);
+    // 全部释放后合并为一整段，被保留并在再次分配时使用
+    free(addr5);
+    free(addr7);
+    assert(malloc(0x3F8) == addr5);
+    free(addr5);
     // 全部释放
-    //    kfree(addr1);
-    //    kfree(addr2);
-    //    kfree(addr3);
-    //    kfree(addr4);
+    free(addr2);
+    free(addr3);
+    free(addr4);
+    // kmalloc 较小的请求由对象缓存分配
+    addr2 = kmalloc(0x1);
+    addr3 = kmalloc(KMEM_CACHE_MAX_SIZE);
+    assert((addr2 != nullptr) && (addr3 != nullptr));
+    assert(kmem_cache_t::find(addr2) != nullptr);
+    assert(kmem_cache_t::find(addr3) != nullptr);
+    assert(kmem_cache_t::find(addr2) != kmem_cache_t::find(addr3));
+    // 使用能容纳的最小的一级
+    assert(kmem_cache_t::find(addr2)->get_size() == 8);
+    addr4 = kmalloc(33);
+    assert(kmem_cache_t::find(addr4)->get_size() == 48);
+    kfree(addr4);
+    addr4 = kmalloc(193);
+    assert(kmem_cache_t::find(addr4)->get_size() == 256);
+    kfree(addr4);
+    // 小对象没有头部，连续分配的对象相邻
+    addr1 = kmalloc(16);
+    addr4 = kmalloc(16);
+    assert(kmem_cache_t::find(addr1)->get_size() == 16);
+    assert((uint8_t*)addr1 - (uint8_t*)addr4 == 16);
+    kfree(addr1);
+    kfree(addr4);
+    // 更大的由 SLAB 分配
+    addr4 = kmalloc(KMEM_CACHE_MAX_SIZE + 1);
+    assert((addr4 != nullptr) && (kmem_cache_t::find(addr4) == nullptr));
+    kfree(addr4);
+    // 释放后再次分配同样长度的，直接从当前 CPU 的 magazine 中得到
+    kmem_stat_t stat = HEAP::get_instance().get_kmalloc_stat();
+    kfree(addr2);
+    assert(kmalloc(0x10) == addr2);
+    kmem_stat_t stat_new = HEAP::get_instance().get_kmalloc_stat();
+    assert(stat_new.alloc_hit == stat.alloc_hit + 1);
+    assert(stat_new.free_hit == stat.free_hit + 1);
+    kfree(addr2);
+    kfree(addr3);
     info("heap test done.\n");
     return 0;
 }
 
+/// 对象缓存测试中同时分配的对象数
+static constexpr const size_t KMEM_TEST_OBJS = 512;
+static void*                  kmem_test_objs[KMEM_TEST_OBJS];
+
+int test_kmem_cache(void) {
+    // 参数错误
+    assert(kmem_cache_create("test", 0, 0) == nullptr);
+    assert(kmem_cache_create("test", 24, 3) == nullptr);
+    assert(kmem_cache_create("test", KMEM_CACHE_MAX_SIZE + 1, 0) == nullptr);
+    // 小对象按字长对齐，没有额外的头部
+    kmem_cache_t* cache = kmem_cache_create("test", 20, 0);
+    assert(cache != nullptr);
+    assert(cache->get_size() == COMMON::ALIGN((size_t)20, sizeof(void*)));
+    // 分配多个 slab 的对象，互不重叠
+    for (size_t i = 0; i < KMEM_TEST_OBJS; i++) {
+        kmem_test_objs[i] = kmem_cache_alloc(cache);
+        assert(kmem_test_objs[i] != nullptr);
+        assert(((uintptr_t)kmem_test_objs[i] & (sizeof(void*) - 1)) == 0);
+        assert(kmem_cache_t::find(kmem_test_objs[i]) == cache);
+        memset(kmem_test_objs[i], (int)i, 20);
+    }
+    assert(cache->get_inuse() == KMEM_TEST_OBJS);
+    assert(cache->get_slab_count() > 1);
+    for (size_t i = 0; i < KMEM_TEST_OBJS; i++) {
+        for (size_t j = 0; j < 20; j++) {
+            assert(((uint8_t*)kmem_test_objs[i])[j] == (uint8_t)i);
+        }
+    }
+    // 最近释放的对象最先被分配
+    void* obj = kmem_test_objs[KMEM_TEST_OBJS / 2];
+    kmem_cache_free(cache, obj);
+    assert(kmem_cache_alloc(cache) == obj);
+    // 全部释放后，归还 magazine 与空 slab
+    for (size_t i = 0; i < KMEM_TEST_OBJS; i++) {
+        kmem_cache_free(cache, kmem_test_objs[i]);
+    }
+    assert(cache->shrink() != 0);
+    assert(cache->get_inuse() == 0);
+    assert(cache->get_slab_count() == 0);
+    // 成对的分配与释放都在 magazine 中完成
+    obj              = kmem_cache_alloc(cache);
+    kmem_stat_t stat = cache->get_stat();
+    kmem_cache_free(cache, obj);
+    assert(kmem_cache_alloc(cache) == obj);
+    kmem_cache_free(cache, obj);
+    assert(cache->get_stat().alloc_hit == stat.alloc_hit + 1);
+    assert(cache->get_stat().free_hit == stat.free_hit + 2);
+    // 大对象使用多页的 slab，任意一页中的对象都能找到所属的缓存
+    kmem_cache_t* big = kmem_cache_create("test big", 1000, 64);
+    assert(big != nullptr);
+    for (size_t i = 0; i < 32; i++) {
+        kmem_test_objs[i] = kmem_cache_alloc(big);
+        assert(kmem_test_objs[i] != nullptr);
+        assert(((uintptr_t)kmem_test_objs[i] & 63) == 0);
+        assert(kmem_cache_t::find(kmem_test_objs[i]) == big);
+    }
+    for (size_t i = 0; i < 32; i++) {
+        kmem_cache_free(big, kmem_test_objs[i]);
+    }
+    assert(big->shrink() != 0);
+    assert(big->get_slab_count() == 0);
+    kmem_cache_destroy(big);
+    kmem_cache_destroy(cache);
+    // 不在 slab 中的地址
+    assert(kmem_cache_t::find(&obj) == nullptr);
+    info("kmem_cache test done.\n");
+    return 0;
+}
+
+int test_mm(void) {
+    // 在内核的恒等映射之后测试
+    uintptr_t va
+      = COMMON::ALIGN(PMM::get_instance().get_pmm_end(), VMM_PGD_ENTRY_SIZE);
+    uintptr_t pa = 0;
+    uint32_t  rw = VMM_PAGE_READABLE | VMM_PAGE_WRITABLE;
+    mm_t      mm(VMM::get_instance().get_pgd());
+    // 不能覆盖内核的恒等映射与直接映射
+    assert(mm.mmap(PMM::get_instance().get_pmm_end() - COMMON::PAGE_SIZE,
+                   COMMON::PAGE_SIZE, rw, vma_t::ANON)
+           == false);
+    assert(mm.mmap(VMM_PA2VA(PMM::get_instance().get_pmm_start()),
+                   COMMON::PAGE_SIZE, rw, vma_t::ANON)
+           == false);
+    // 相邻且属性相同的区域被合并
+    assert(mm.mmap(va, 4 * COMMON::PAGE_SIZE, rw, vma_t::ANON) == true);
+    assert(mm.mmap(va + 8 * COMMON::PAGE_SIZE, 4 * COMMON::PAGE_SIZE, rw,
+                   vma_t::ANON)
+           == true);
+    assert(mm.get_vma_count() == 2);
+    assert(mm.mmap(va + 4 * COMMON::PAGE_SIZE, 4 * COMMON::PAGE_SIZE, rw,
+                   vma_t::ANON)
+           == true);
+    assert(mm.get_vma_count() == 1);
+    assert(mm.find_vma(va + 5 * COMMON::PAGE_SIZE)->start == va);
+    assert(mm.find_vma(va)->end == va + 12 * COMMON::PAGE_SIZE);
+    assert(mm.find_vma(va - COMMON::PAGE_SIZE) == nullptr);
+    assert(mm.find_vma(va + 12 * COMMON::PAGE_SIZE) == nullptr);
+    // 不能与已有区域重叠
+    assert(mm.mmap(va + 2 * COMMON::PAGE_SIZE, 4 * COMMON::PAGE_SIZE, rw,
+                   vma_t::ANON)
+           == false);
+    // 保护页属性不同，不会合并，访问即错误
+    assert(mm.mmap(va + 12 * COMMON::PAGE_SIZE, COMMON::PAGE_SIZE, 0,
+                   vma_t::GUARD)
+           == true);
+    assert(mm.get_vma_count() == 2);
+    assert(mm.fault(va + 12 * COMMON::PAGE_SIZE, false) == false);
+    // 缺页时分配清零的页
+    assert(mm.fault(va + COMMON::PAGE_SIZE + 8, true) == true);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), va + COMMON::PAGE_SIZE,
+                                        &pa)
+           == true);
+    assert(*(uintptr_t*)VMM_PA2VA(pa) == 0);
+    // 取消中间一页的映射，区域被分割
+    assert(mm.munmap(va + COMMON::PAGE_SIZE, COMMON::PAGE_SIZE) == true);
+    assert(mm.get_vma_count() == 3);
+    assert(mm.find_vma(va + COMMON::PAGE_SIZE) == nullptr);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), va + COMMON::PAGE_SIZE,
+                                        nullptr)
+           == false);
+    assert(mm.fault(va + COMMON::PAGE_SIZE, false) == false);
+    // 只读区域不允许写
+    assert(mm.mmap(va + 16 * COMMON::PAGE_SIZE, COMMON::PAGE_SIZE,
+                   VMM_PAGE_READABLE, vma_t::ANON)
+           == true);
+    assert(mm.fault(va + 16 * COMMON::PAGE_SIZE, true) == false);
+    assert(mm.fault(va + 16 * COMMON::PAGE_SIZE, false) == true);
+    // 物理内存区域立即映射
+    uintptr_t phys = PMM::get_instance().alloc_pages(2);
+    assert(phys != 0);
+    assert(mm.mmap(va + 32 * COMMON::PAGE_SIZE, 2 * COMMON::PAGE_SIZE, rw,
+                   vma_t::PHYS, phys)
+           == true);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(),
+                                        va + 33 * COMMON::PAGE_SIZE, &pa)
+           == true);
+    assert(pa == phys + COMMON::PAGE_SIZE);
+    // 取消跨越多个区域的范围
+    assert(mm.munmap(va, 64 * COMMON::PAGE_SIZE) == true);
+    assert(mm.get_vma_count() == 0);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(),
+                                        va + 32 * COMMON::PAGE_SIZE, nullptr)
+           == false);
+    PMM::get_instance().free_pages(phys, 2);
+    // 读缺页映射共享的只读零页，写入时才分配
+    uintptr_t pa_zero = 0;
+    uint32_t  flag    = 0;
+    assert(mm.mmap(va, 16 * COMMON::PAGE_SIZE, rw, vma_t::ANON) == true);
+    for (size_t i = 0; i < 16; i++) {
+        assert(mm.fault(va + i * COMMON::PAGE_SIZE, false) == true);
+        assert(VMM::get_instance().get_mmap(
+                 mm.get_pgd(), va + i * COMMON::PAGE_SIZE, &pa, &flag)
+               == true);
+        assert((flag & VMM_PAGE_WRITABLE) == 0);
+        if (i == 0) {
+            pa_zero = pa;
+        }
+        assert(pa == pa_zero);
+    }
+    assert(*(uintptr_t*)VMM_PA2VA(pa_zero) == 0);
+    assert(mm.fault(va + 3 * COMMON::PAGE_SIZE, true) == true);
+    assert(VMM::get_instance().get_mmap(
+             mm.get_pgd(), va + 3 * COMMON::PAGE_SIZE, &pa, &flag)
+           == true);
+    assert((pa != pa_zero) && ((flag & VMM_PAGE_WRITABLE) != 0));
+    assert(*(uintptr_t*)VMM_PA2VA(pa) == 0);
+    assert(mm.munmap(va, 16 * COMMON::PAGE_SIZE) == true);
+    // 读缺页时一起映射对齐窗口内的页
+    assert(mm.get_fault_around() == MM_FAULT_AROUND_PAGES);
+    assert(mm.mmap(va, 4 * MM_FAULT_AROUND_PAGES * COMMON::PAGE_SIZE, rw,
+                   vma_t::ANON)
+           == true);
+    assert(mm.fault(va + 5 * COMMON::PAGE_SIZE, false) == true);
+    for (size_t i = 0; i < MM_FAULT_AROUND_PAGES; i++) {
+        assert(VMM::get_instance().get_mmap(
+                 mm.get_pgd(), va + i * COMMON::PAGE_SIZE, &pa)
+               == true);
+        assert(pa == pa_zero);
+    }
+    assert(VMM::get_instance().get_mmap(
+             mm.get_pgd(), va + MM_FAULT_AROUND_PAGES * COMMON::PAGE_SIZE,
+             nullptr)
+           == false);
+    // 写缺页只映射缺页的页
+    assert(mm.fault(va + 3 * MM_FAULT_AROUND_PAGES * COMMON::PAGE_SIZE, true)
+           == true);
+    assert(VMM::get_instance().get_mmap(
+             mm.get_pgd(),
+             va + (3 * MM_FAULT_AROUND_PAGES + 1) * COMMON::PAGE_SIZE, nullptr)
+           == false);
+    // 关闭后只映射缺页的页
+    mm.set_fault_around(1);
+    assert(mm.fault(va + 2 * MM_FAULT_AROUND_PAGES * COMMON::PAGE_SIZE, true)
+           == true);
+    assert(VMM::get_instance().get_mmap(
+             mm.get_pgd(),
+             va + (2 * MM_FAULT_AROUND_PAGES + 1) * COMMON::PAGE_SIZE, nullptr)
+           == false);
+    mm.set_fault_around(MM_FAULT_AROUND_PAGES);
+    assert(mm.munmap(va, 4 * MM_FAULT_AROUND_PAGES * COMMON::PAGE_SIZE)
+           == true);
+    // 预先映射整个区域，跨越多个批次
+    size_t populate_pages = MM_BATCH_PAGES + 3;
+    assert(mm.mmap(va, populate_pages * COMMON::PAGE_SIZE,
+                   rw | MM_MAP_POPULATE, vma_t::ANON)
+           == true);
+    assert(mm.find_vma(va)->flag == rw);
+    for (size_t i = 0; i < populate_pages; i++) {
+        assert(VMM::get_instance().get_mmap(
+                 mm.get_pgd(), va + i * COMMON::PAGE_SIZE, &pa, &flag)
+               == true);
+        assert((pa != pa_zero) && ((flag & VMM_PAGE_WRITABLE) != 0));
+    }
+    assert(mm.munmap(va, populate_pages * COMMON::PAGE_SIZE) == true);
+    // 复制地址空间，私有页写时复制
+    uintptr_t pa_old = 0;
+    assert(mm.mmap(va, 2 * COMMON::PAGE_SIZE, rw, vma_t::ANON) == true);
+    assert(mm.fault(va, true) == true);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), va, &pa_old) == true);
+    *(uintptr_t*)VMM_PA2VA(pa_old) = 0x233;
+    // 复制前分配的内核堆
+    uintptr_t* heap_old            = (uintptr_t*)malloc(0x100);
+    assert(heap_old != nullptr);
+    *heap_old   = 0x233;
+    mm_t* child = mm.clone();
+    assert(child != nullptr);
+    assert(child->get_vma_count() == mm.get_vma_count());
+    // 内核堆不在区域中，不会被写时复制，仍然可写且没有增加引用
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), (uintptr_t)heap_old,
+                                        nullptr, &flag)
+           == true);
+    assert((flag & VMM_PAGE_WRITABLE) != 0);
+    assert(PMM::get_instance().addr_to_page((uintptr_t)heap_old)->ref == 1);
+    *heap_old           = 0x666;
+    uintptr_t* heap_new = (uintptr_t*)malloc(0x100);
+    assert(heap_new != nullptr);
+    *heap_new = 0x233;
+    // 复制后内核修改的映射在两边相同
+    uint32_t child_flag = 0;
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), (uintptr_t)heap_new,
+                                        nullptr, &flag)
+           == true);
+    assert(VMM::get_instance().get_mmap(child->get_pgd(), (uintptr_t)heap_new,
+                                        nullptr, &child_flag)
+           == true);
+    assert(flag == child_flag);
+    free(heap_new);
+    free(heap_old);
+    // 两边映射同一页，并且都是只读的
+    assert(VMM::get_instance().get_mmap(child->get_pgd(), va, &pa, &flag)
+           == true);
+    assert((pa == pa_old) && ((flag & VMM_PAGE_WRITABLE) == 0));
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), va, nullptr, &flag)
+           == true);
+    assert((flag & VMM_PAGE_WRITABLE) == 0);
+    // 写入时只复制被写入的页
+    assert(child->fault(va + 8, true) == true);
+    assert(VMM::get_instance().get_mmap(child->get_pgd(), va, &pa, &flag)
+           == true);
+    assert((pa != pa_old) && ((flag & VMM_PAGE_WRITABLE) != 0));
+    assert(*(uintptr_t*)VMM_PA2VA(pa) == 0x233);
+    *(uintptr_t*)VMM_PA2VA(pa) = 0x666;
+    assert(*(uintptr_t*)VMM_PA2VA(pa_old) == 0x233);
+    // 原来的页只剩一个引用，直接改为可写
+    assert(mm.fault(va, true) == true);
+    assert(VMM::get_instance().get_mmap(mm.get_pgd(), va, &pa, &flag) == true);
+    assert((pa == pa_old) && ((flag & VMM_PAGE_WRITABLE) != 0));
+    delete child;
+    assert(mm.munmap(va, 2 * COMMON::PAGE_SIZE) == true);
+    // 物理内存区域只归还复制地址空间时增加的引用，其它持有者的引用不受影响
+    uintptr_t pa_phys = PMM::get_instance().alloc_page();
+    assert(pa_phys != 0);
+    PMM::get_instance().get_page(pa_phys);
+    assert(mm.mmap(va, COMMON::PAGE_SIZE, rw, vma_t::PHYS, pa_phys) == true);
+    child = mm.clone();
+    assert(child != nullptr);
+    assert(PMM::get_instance().addr_to_page(pa_phys)->ref == 3);
+    delete child;
+    assert(PMM::get_instance().addr_to_page(pa_phys)->ref == 2);
+    assert(mm.munmap(va, COMMON::PAGE_SIZE) == true);
+    assert(PMM::get_instance().addr_to_page(pa_phys)->ref == 2);
+    PMM::get_instance().put_page(pa_phys);
+    assert(PMM::get_instance().put_page(pa_phys) == true);
+    info("mm test done.\n");
+    return 0;
+}
+
 // TODO: 更多测试
 int test_intr(void) {
+    // 在内核的恒等映射之后建立匿名区域，由缺页处理分配物理页
+    uintptr_t va
+      = COMMON::ALIGN(PMM::get_instance().get_pmm_end(), VMM_PGD_ENTRY_SIZE);
+    mm_t mm(VMM::get_instance().get_pgd());
+    assert(mm.mmap(va, COMMON::PAGE_SIZE,
+                   VMM_PAGE_READABLE | VMM_PAGE_WRITABLE, vma_t::ANON)
+           == true);
+    mm.switch_to();
     // 触发 pg 中断
-    uintptr_t* addr = (uintptr_t*)0xC0000000;
+    uintptr_t* addr = (uintptr_t*)va;
     int        tmp  = 0x666;
     tmp             = *addr;
     assert(tmp == 0);
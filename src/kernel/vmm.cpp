@@ -18,56 +18,268 @@
 #include "cpu.hpp"
 #include "cstdint"
 #include "cstdio"
-#include "cstring"
 #if defined(__i386__) || defined(__x86_64__)
 #    include "gdt.h"
 #endif
 #include "pmm.h"
 #include "vmm.h"
 
-// 在 _pgd 中查找 _va 对应的页表项
+pt_t VMM::pa2pt(uintptr_t _pa) const {
+    return (pt_t)(_pa + pt_offset);
+}
+
+uintptr_t VMM::alloc_table(void) {
+    uintptr_t pa = PMM::get_instance().alloc_zeroed_page();
+    if (pa != 0) {
+        // 页描述符中可能还有之前的所有者留下的数据
+        page_t* page = PMM::get_instance().addr_to_page(pa);
+        assert(page != nullptr);
+        page->prev = 0;
+        page->next = 0;
+        pt_pages++;
+    }
+    return pa;
+}
+
+void VMM::free_table(uintptr_t _pa) {
+    // 与复制出的页目录共享的页表只减少引用，由最后一个使用者释放
+    if (PMM::get_instance().put_page(_pa) == true) {
+        pt_pages--;
+    }
+    return;
+}
+
+void VMM::set_pte(const pt_t _pgd, pte_t* _pte, pte_t _val) {
+    bool valid_old = (*_pte & VMM_PAGE_VALID) == VMM_PAGE_VALID;
+    bool valid_new = (_val & VMM_PAGE_VALID) == VMM_PAGE_VALID;
+    *_pte          = _val;
+    if (valid_old == valid_new) {
+        return;
+    }
+    // 页目录不会因为变空被释放，其页描述符保存的是 ASID
+    uintptr_t pa = ((uintptr_t)_pte & COMMON::PAGE_MASK) - pt_offset;
+    if (pa == (uintptr_t)_pgd) {
+        return;
+    }
+    page_t* page = PMM::get_instance().addr_to_page(pa);
+    assert(page != nullptr);
+    if (valid_new == true) {
+        page->prev++;
+    }
+    else {
+        assert(page->prev != 0);
+        page->prev--;
+    }
+    return;
+}
+
+size_t VMM::free_empty(const pt_t _pgd, uintptr_t _va, size_t _level) {
+    size_t freed = 0;
+    for (size_t level = _level; level < VMM_PT_LEVEL - 1; level++) {
+        // 上一级页表中指向第 level 级页表的页表项
+        size_t parent = level + 1;
+        pte_t* pte    = find(_pgd, _va, false, parent);
+        assert((pte != nullptr) && ((*pte & VMM_PAGE_VALID) == VMM_PAGE_VALID));
+        uintptr_t pa = PTE2PA(*pte);
+        if (PMM::get_instance().addr_to_page(pa)->prev != 0) {
+            break;
+        }
+        set_pte(_pgd, pte, 0x00);
+        free_table(pa);
+        freed++;
+    }
+    return freed;
+}
+
+// 在 _pgd 中查找 _va 对应的第 _level 级页表项
 // 如果未找到，_alloc 为真时会进行分配
-pte_t* VMM::find(const pt_t _pgd, uintptr_t _va, bool _alloc) {
-    pt_t pgd = _pgd;
+pte_t* VMM::find(const pt_t _pgd, uintptr_t _va, bool _alloc, size_t& _level) {
+    pt_t pgd = pa2pt((uintptr_t)_pgd);
     // sv39 共有三级页表，一级一级查找
-    // -1 是因为最后一级是具体的某一页，在函数最后直接返回
-    for (size_t level = VMM_PT_LEVEL - 1; level > 0; level--) {
+    // 到第 _level 级时停止，在函数最后直接返回
+    for (size_t level = VMM_PT_LEVEL - 1; level > _level; level--) {
         // 每次循环会找到 _va 的第 level 级页表 pgd
         // 相当于 pgd_level[VPN_level]，这样相当于得到了第 level 级页表的地址
         pte_t* pte = (pte_t*)&pgd[PX(level, _va)];
         // 解引用 pte，如果有效，获取 level+1 级页表，
         if ((*pte & VMM_PAGE_VALID) == 1) {
+            // 是大页
+            if (is_leaf(*pte, level) == true) {
+                // 不分配的话返回大页的页表项
+                if (_alloc == false) {
+                    _level = level;
+                    return pte;
+                }
+                // 否则拆分为下一级页表
+                if (split(pte, level) == false) {
+                    assert(0);
+                    return nullptr;
+                }
+            }
             // pgd 指向下一级页表
             // *pte 保存的是页表项，需要转换为对应的物理地址
-            pgd = (pt_t)PTE2PA(*pte);
+            pgd = pa2pt(PTE2PA(*pte));
         }
         // 如果无效
         else {
             // 判断是否需要分配
             // 如果需要
             if (_alloc == true) {
-                // 申请新的物理页
-                pgd = (pt_t)PMM::get_instance().alloc_page_kernel();
-                bzero(pgd, COMMON::PAGE_SIZE);
+                // 申请新的物理页，已经清零
+                uintptr_t pa = alloc_table();
                 // 申请失败则返回
-                if (pgd == nullptr) {
+                if (pa == 0) {
                     // 如果出现这种情况，说明物理内存不够，一般不会出现
                     assert(0);
                     return nullptr;
                 }
-                // 清零
-                bzero(pgd, COMMON::PAGE_SIZE);
+                pgd = pa2pt(pa);
                 // 填充页表项
-                *pte = PA2PTE((uintptr_t)pgd) | VMM_PAGE_VALID;
+                set_pte(_pgd, pte, PA2PTE(pa) | VMM_PAGE_VALID);
             }
             // 不分配的话直接返回
             else {
+                _level = level;
                 return nullptr;
             }
         }
     }
-    // 0 最低级 pt
-    return &pgd[PX(0, _va)];
+    return &pgd[PX(_level, _va)];
+}
+
+bool VMM::split(pte_t* _pte, size_t _level) {
+    uintptr_t pt_pa = alloc_table();
+    if (pt_pa == 0) {
+        return false;
+    }
+    pt_t      pt   = pa2pt(pt_pa);
+    uintptr_t pa   = PTE2PA(*_pte);
+    uintptr_t flag = *_pte & ((1 << VMM_PTE_PROP_BITS) - 1);
+    // 最低级页表项没有大页标志，x86 中这一位是 PAT
+    if (_level == 1) {
+        flag &= ~(uintptr_t)VMM_PAGE_HUGE;
+    }
+    // 下一级的每一项映射大页中的一部分，属性不变
+    for (size_t i = 0; i < VMM_PAGES_PRE_PAGE_TABLE; i++) {
+        pt[i] = PA2PTE(pa + i * PXSIZE(_level - 1)) | flag;
+    }
+    PMM::get_instance().addr_to_page(pt_pa)->prev = VMM_PAGES_PRE_PAGE_TABLE;
+    // 替换为指向下一级页表的页表项
+    *_pte = PA2PTE(pt_pa) | VMM_PAGE_VALID;
+    return true;
+}
+
+void VMM::flush(const pt_t _pgd, uintptr_t _start, uintptr_t _end,
+                bool _global) {
+    // 没有修改
+    if (_start == _end) {
+        return;
+    }
+    // 修改的不是当前页目录
+    if (_pgd != get_pgd()) {
+        // TLB 中可能还有它的 ASID 的旧映射，使 ASID 失效，
+        // 下次切换时会分配新的 ASID，没有使用 ASID 时切换会刷新
+        if (asid_bits != 0) {
+            page_t* page = PMM::get_instance().addr_to_page((uintptr_t)_pgd);
+            assert(page != nullptr);
+            page->next = 0;
+        }
+        // 全局页在所有地址空间中共享，仍然需要刷新
+        if (_global == false) {
+            return;
+        }
+    }
+    // 页数较少时逐页刷新
+    if (_end - _start <= VMM_FLUSH_PAGES_MAX * COMMON::PAGE_SIZE) {
+        for (uintptr_t addr = _start; addr < _end; addr += COMMON::PAGE_SIZE) {
+            CPU::VMM_FLUSH(addr);
+        }
+    }
+    // 修改了全局页，需要刷新全部
+    else if (_global == true) {
+        CPU::VMM_FLUSH_ALL();
+    }
+    // 否则只刷新当前地址空间，全局的内核映射保留在 TLB 中
+    else {
+        CPU::VMM_FLUSH_ASID(get_asid(_pgd));
+    }
+    return;
+}
+
+bool VMM::clone_pt(pt_t _dst, const pt_t _src, size_t _level) {
+    pt_t   dst   = pa2pt((uintptr_t)_dst);
+    pt_t   src   = pa2pt((uintptr_t)_src);
+    size_t valid = 0;
+    for (size_t i = 0; i < VMM_PAGES_PRE_PAGE_TABLE; i++) {
+        if ((src[i] & VMM_PAGE_VALID) == 0) {
+            continue;
+        }
+        valid++;
+        // 下级页表需要复制
+        if ((_level > 0) && (is_leaf(src[i], _level) == false)) {
+            // 已经复制的页表挂在 _dst 中，由调用者释放
+            uintptr_t pa = alloc_table();
+            if (pa == 0) {
+                return false;
+            }
+            dst[i] = PA2PTE(pa) | (src[i] & ((1 << VMM_PTE_PROP_BITS) - 1));
+            if (clone_pt((pt_t)pa, (pt_t)PTE2PA(src[i]), _level - 1)
+                == false) {
+                return false;
+            }
+            continue;
+        }
+        // 叶子页表项直接共享，私有页在 cow_range 中设置写时复制
+        dst[i] = src[i];
+    }
+    PMM::get_instance().addr_to_page((uintptr_t)_dst)->prev = valid;
+    return true;
+}
+
+void VMM::free_pt(pt_t _pt, size_t _level) {
+    // 共享的页表只减少引用
+    if (PMM::get_instance().addr_to_page((uintptr_t)_pt)->ref > 1) {
+        free_table((uintptr_t)_pt);
+        return;
+    }
+    pt_t pt = pa2pt((uintptr_t)_pt);
+    for (size_t i = 0; (_level > 0) && (i < VMM_PAGES_PRE_PAGE_TABLE); i++) {
+        if (((pt[i] & VMM_PAGE_VALID) == VMM_PAGE_VALID)
+            && (is_leaf(pt[i], _level) == false)) {
+            free_pt((pt_t)PTE2PA(pt[i]), _level - 1);
+        }
+    }
+    free_table((uintptr_t)_pt);
+    return;
+}
+
+void VMM::init_asid(void) {
+    asid_generation = 1;
+    asid_next       = 1;
+#if defined(__x86_64__)
+    // 开启 PCIDE 时 CR3 的低 12 位需要为 0
+    // 重新加载 CR3 只刷新当前 PCID，没有全局页时 VMM_FLUSH_ALL
+    // 无法刷新其它 PCID 中的内核映射，此时不使用 PCID
+    if ((CPU::CPUID().pcid() == true)
+        && ((CPU::READ_CR4() & CPU::CR4_PGE) != 0)) {
+        CPU::WRITE_CR4(CPU::READ_CR4() | CPU::CR4_PCIDE);
+        asid_bits = VMM_PCID_BITS;
+    }
+    else {
+        asid_bits = 0;
+    }
+#elif defined(__riscv)
+    asid_bits = CPU::GET_ASID_BITS();
+#else
+    asid_bits = 0;
+#endif
+    info("vmm: %d ASID bits.\n", asid_bits);
+    return;
+}
+
+pt_t VMM::new_pgd(void) {
+    // 页描述符已经被清除，没有旧的 ASID
+    return (pt_t)alloc_table();
 }
 
 VMM& VMM::get_instance(void) {
@@ -79,22 +291,65 @@ VMM& VMM::get_instance(void) {
 bool VMM::init(void) {
 #if defined(__i386__) || defined(__x86_64__)
     GDT::init();
+#endif
+    // 确定可以使用的大页
+#if defined(__i386__)
+    // 4MB 页需要开启 PSE
+    if (CPU::CPUID().pse() == true) {
+        CPU::WRITE_CR4(CPU::READ_CR4() | CPU::CR4_PSE);
+        huge_level = 1;
+    }
+    else {
+        huge_level = 0;
+    }
+#elif defined(__x86_64__)
+    // 2MB 页总是可用，1GB 页需要 CPU 支持
+    huge_level = CPU::CPUID().page1gb() ? 2 : 1;
+#else
+    huge_level = VMM_HUGE_LEVEL;
+#endif
+    // 复制出的地址空间中顶级页表项是副本，只有下级页表是共享的
+    // 内核映射不使用顶级页表项映射大页，之后的修改才能对所有地址空间可见
+    if (huge_level > VMM_PT_LEVEL - 2) {
+        huge_level = VMM_PT_LEVEL - 2;
+    }
+#if defined(__i386__) || defined(__x86_64__)
+    // 开启全局页，内核的直接映射在切换页目录时不会被刷新
+    if (CPU::CPUID().pge() == true) {
+        CPU::WRITE_CR4(CPU::READ_CR4() | CPU::CR4_PGE);
+    }
 #endif
     // 分配一页用于保存页目录
-    pt_t pgd_kernel = (pt_t)PMM::get_instance().alloc_page_kernel();
-    bzero(pgd_kernel, COMMON::PAGE_SIZE);
-    // 映射内核空间
-    for (uintptr_t addr = (uintptr_t)COMMON::KERNEL_START_ADDR;
-         addr < (uintptr_t)COMMON::KERNEL_START_ADDR + VMM_KERNEL_SPACE_SIZE;
-         addr += COMMON::PAGE_SIZE) {
-        // TODO: 区分代码/数据等段分别映射
-        mmap(pgd_kernel, addr, addr,
-             VMM_PAGE_READABLE | VMM_PAGE_WRITABLE | VMM_PAGE_EXECUTABLE);
+    pt_t pgd_kernel = new_pgd();
+    // 内核在物理地址上链接运行，恒等映射内核空间与其后所有的物理内存
+    // 内核空间不足时，内核使用的页会从其它 zone 分配，需要可以直接访问
+    // 使用大页以减少页表与 TLB 的占用
+    // TODO: 区分代码/数据等段分别映射
+    mmap_range(pgd_kernel, (uintptr_t)COMMON::KERNEL_START_ADDR,
+               (uintptr_t)COMMON::KERNEL_START_ADDR,
+               PMM::get_instance().get_pmm_end()
+                 - (uintptr_t)COMMON::KERNEL_START_ADDR,
+               VMM_PAGE_KERNEL);
+    // 在 KERNEL_OFFSET 处直接映射所有物理内存
+    uintptr_t direct_start = PMM::get_instance().get_pmm_start();
+    uintptr_t direct_end   = PMM::get_instance().get_pmm_end();
+    if (direct_end > VMM_DIRECT_MAP_SIZE) {
+        warn("vmm: memory above 0x%p is not direct mapped.\n",
+             VMM_DIRECT_MAP_SIZE);
+        direct_end = VMM_DIRECT_MAP_SIZE;
     }
+    mmap_range(pgd_kernel, VMM_PA2VA(direct_start), direct_start,
+               direct_end - direct_start, VMM_PAGE_KERNEL);
     // 设置页目录
     set_pgd(pgd_kernel);
     // 开启分页
     CPU::ENABLE_PG();
+    CPU::VMM_FLUSH_ALL();
+    // 之后通过直接映射区访问页表
+    pt_offset = KERNEL_OFFSET;
+    // 开启 ASID 后重新设置，为内核页目录分配 ASID
+    init_asid();
+    set_pgd(pgd_kernel);
     info("vmm init.\n");
     return 0;
 }
@@ -104,17 +359,83 @@ pt_t VMM::get_pgd(void) {
 }
 
 void VMM::set_pgd(const pt_t _pgd) {
-    // 设置页目录
-    CPU::SET_PGD((uintptr_t)_pgd);
-    // 刷新缓存
-    CPU::VMM_FLUSH(0);
+    // 不使用 ASID
+    if (asid_bits == 0) {
+        // 设置页目录
+        CPU::SET_PGD((uintptr_t)_pgd);
+        // 刷新当前地址空间，全局的内核映射在所有页目录中相同，不需要刷新
+        // x86 写 CR3 时已经刷新
+#if defined(__riscv)
+        CPU::VMM_FLUSH_ASID(0);
+#endif
+        return;
+    }
+    page_t* page     = PMM::get_instance().addr_to_page((uintptr_t)_pgd);
+    bool    rollover = false;
+    assert(page != nullptr);
+    // ASID 已经失效，重新分配
+    if (page->next != asid_generation) {
+        // 用完后开始新的一代，之前分配的 ASID 全部失效
+        if ((asid_next >> asid_bits) != 0) {
+            asid_generation++;
+            asid_next = 1;
+            rollover  = true;
+        }
+        page->prev = asid_next;
+        page->next = asid_generation;
+        asid_next++;
+    }
+    // 同一代中 ASID 不会重复分配，TLB 中缓存的一定是 _pgd 的映射，
+    // 不需要刷新
+    CPU::SET_PGD((uintptr_t)_pgd, page->prev, rollover);
+    // 新的一代需要清除 TLB 中所有旧的 ASID
+    if (rollover == true) {
+        CPU::VMM_FLUSH_ALL();
+    }
     return;
 }
 
-void VMM::mmap(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, uint32_t _flag) {
-    pte_t* pte = find(_pgd, _va, true);
+size_t VMM::get_asid(const pt_t _pgd) const {
+    if (asid_bits == 0) {
+        return 0;
+    }
+    page_t* page = PMM::get_instance().addr_to_page((uintptr_t)_pgd);
+    assert(page != nullptr);
+    if (page->next != asid_generation) {
+        return 0;
+    }
+    return page->prev;
+}
+
+size_t VMM::get_pt_pages(void) const {
+    return pt_pages;
+}
+
+size_t VMM::get_huge_level(void) const {
+    return huge_level;
+}
+
+void VMM::mmap(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, uint32_t _flag,
+               size_t _level) {
+    assert(_level <= huge_level);
+    assert(((_va | _pa) & (PXSIZE(_level) - 1)) == 0);
+    size_t level = _level;
+    pte_t* pte   = find(_pgd, _va, true, level);
     // 一般情况下不应该为空
     assert(pte != nullptr);
+    // 要映射大页的位置已经有下一级页表，在下一级逐项映射
+    if ((_level > 0) && ((*pte & VMM_PAGE_VALID) == VMM_PAGE_VALID)
+        && (is_leaf(*pte, _level) == false)) {
+        for (size_t i = 0; i < VMM_PAGES_PRE_PAGE_TABLE; i++) {
+            mmap(_pgd, _va + i * PXSIZE(_level - 1),
+                 _pa + i * PXSIZE(_level - 1), _flag, _level - 1);
+        }
+        return;
+    }
+    // 大页需要设置大页标志
+    if (_level > 0) {
+        _flag |= VMM_PAGE_HUGE;
+    }
     // 已经映射过了 且 flag 没有变化
     if (((*pte & VMM_PAGE_VALID) == VMM_PAGE_VALID)
         && ((*pte & ((1 << VMM_PTE_PROP_BITS) - 1)) == _flag)) {
@@ -124,16 +445,116 @@ void VMM::mmap(const pt_t _pgd, uintptr_t _va, uintptr_t _pa, uint32_t _flag) {
     else {
         // 那么设置 *pte
         // pte 解引用后的值是页表项
-        *pte = PA2PTE(_pa) | _flag | (*pte & ((1 << VMM_PTE_PROP_BITS) - 1))
-             | VMM_PAGE_VALID;
+        set_pte(_pgd, pte,
+                PA2PTE(_pa) | _flag
+                  | (*pte & ((1 << VMM_PTE_PROP_BITS) - 1)) | VMM_PAGE_VALID);
         // 刷新缓存
-        CPU::VMM_FLUSH(0);
+        flush(_pgd, _va, _va + COMMON::PAGE_SIZE, true);
+    }
+    return;
+}
+
+void VMM::mmap_range(const pt_t _pgd, uintptr_t _va, uintptr_t _pa,
+                     size_t _len, uint32_t _flag) {
+    assert(((_va | _pa | _len) & ~COMMON::PAGE_MASK) == 0);
+    uintptr_t end         = _va + _len;
+    // 需要刷新 TLB 的范围
+    uintptr_t flush_start = 0;
+    uintptr_t flush_end   = 0;
+    // 是否修改了全局页
+    bool      global      = (_flag & VMM_PAGE_GLOBAL) != 0;
+    while (_va < end) {
+        // 找到 _va 与 _pa 均对齐，且不超过剩余长度的最大页
+        size_t level = huge_level;
+        while ((level > 0)
+               && ((((_va | _pa) & (PXSIZE(level) - 1)) != 0)
+                   || (end - _va < PXSIZE(level)))) {
+            level--;
+        }
+        // 已经有下一级页表时，在下一级映射
+        pte_t* pte = nullptr;
+        while (true) {
+            size_t tmp = level;
+            pte        = find(_pgd, _va, true, tmp);
+            // 一般情况下不应该为空
+            assert(pte != nullptr);
+            if ((level == 0) || ((*pte & VMM_PAGE_VALID) == 0)
+                || (is_leaf(*pte, level) == true)) {
+                break;
+            }
+            level--;
+        }
+        uintptr_t flag = _flag | VMM_PAGE_VALID;
+        if (level > 0) {
+            flag |= VMM_PAGE_HUGE;
+        }
+        // 填充同一页表中连续的页表项
+        size_t idx = PX(level, _va);
+        do {
+            if (need_flush(*pte) == true) {
+                if (flush_start == flush_end) {
+                    flush_start = _va;
+                }
+                flush_end  = _va + PXSIZE(level);
+                global    |= (*pte & VMM_PAGE_GLOBAL) != 0;
+            }
+            set_pte(_pgd, pte, PA2PTE(_pa) | flag);
+            pte++;
+            idx++;
+            _va += PXSIZE(level);
+            _pa += PXSIZE(level);
+        } while ((idx < VMM_PAGES_PRE_PAGE_TABLE)
+                 && (end - _va >= PXSIZE(level))
+                 && ((level == 0) || ((*pte & VMM_PAGE_VALID) == 0)
+                     || (is_leaf(*pte, level) == true)));
+    }
+    // 统一刷新
+    flush(_pgd, flush_start, flush_end, global);
+    return;
+}
+
+void VMM::mmap_pages(const pt_t _pgd, uintptr_t _va, const uintptr_t* _pas,
+                     size_t _n, uint32_t _flag) {
+    assert((_va & ~COMMON::PAGE_MASK) == 0);
+    // 需要刷新 TLB 的范围
+    uintptr_t flush_start = 0;
+    uintptr_t flush_end   = 0;
+    // 是否修改了全局页
+    bool      global      = (_flag & VMM_PAGE_GLOBAL) != 0;
+    size_t    i           = 0;
+    while (i < _n) {
+        uintptr_t va    = _va + i * COMMON::PAGE_SIZE;
+        size_t    level = 0;
+        pte_t*    pte   = find(_pgd, va, true, level);
+        // 一般情况下不应该为空
+        assert(pte != nullptr);
+        // 填充同一页表中连续的页表项
+        size_t idx = PX(0, va);
+        do {
+            if (_pas[i] != 0) {
+                if (need_flush(*pte) == true) {
+                    if (flush_start == flush_end) {
+                        flush_start = va;
+                    }
+                    flush_end  = va + COMMON::PAGE_SIZE;
+                    global    |= (*pte & VMM_PAGE_GLOBAL) != 0;
+                }
+                set_pte(_pgd, pte, PA2PTE(_pas[i]) | _flag | VMM_PAGE_VALID);
+            }
+            pte++;
+            idx++;
+            i++;
+            va += COMMON::PAGE_SIZE;
+        } while ((i < _n) && (idx < VMM_PAGES_PRE_PAGE_TABLE));
     }
+    // 统一刷新
+    flush(_pgd, flush_start, flush_end, global);
     return;
 }
 
 void VMM::unmmap(const pt_t _pgd, uintptr_t _va) {
-    pte_t* pte = find(_pgd, _va, false);
+    size_t level = 0;
+    pte_t* pte   = find(_pgd, _va, false, level);
     // 找到页表项
     // 未找到
     if (pte == nullptr) {
@@ -144,24 +565,94 @@ void VMM::unmmap(const pt_t _pgd, uintptr_t _va) {
     if ((*pte & VMM_PAGE_VALID) == 0) {
         warn("VMM::unmmap: not mapped.\n");
     }
+    // 位于大页中，拆分后只取消 _va 所在的页
+    else if (level > 0) {
+        level = 0;
+        pte   = find(_pgd, _va, true, level);
+        assert(pte != nullptr);
+    }
     // 置零
-    *pte = 0x00;
-    // 刷新缓存
-    CPU::VMM_FLUSH(0);
-    // TODO: 如果一页表都被 unmap，释放占用的物理内存
+    set_pte(_pgd, pte, 0x00);
+    // 刷新缓存，释放了页表时刷新整个地址空间
+    if (free_empty(_pgd, _va, level) != 0) {
+        flush(_pgd, 0, COMMON::PAGE_MASK, true);
+    }
+    else {
+        flush(_pgd, _va, _va + COMMON::PAGE_SIZE, true);
+    }
     return;
 }
 
-bool VMM::get_mmap(const pt_t _pgd, uintptr_t _va, const void* _pa) {
-    pte_t* pte = find(_pgd, _va, false);
-    bool   res = false;
+void VMM::unmap_range(const pt_t _pgd, uintptr_t _va, size_t _len) {
+    assert(((_va | _len) & ~COMMON::PAGE_MASK) == 0);
+    uintptr_t end         = _va + _len;
+    // 需要刷新 TLB 的范围
+    uintptr_t flush_start = 0;
+    uintptr_t flush_end   = 0;
+    // 是否修改了全局页
+    bool      global      = false;
+    // 释放的页表数
+    size_t    freed       = 0;
+    while (_va < end) {
+        size_t level = 0;
+        pte_t* pte   = find(_pgd, _va, false, level);
+        // 没有映射，跳过第 level 级页表项对应的范围
+        if ((pte == nullptr) || ((*pte & VMM_PAGE_VALID) == 0)) {
+            _va = (_va & ~(PXSIZE(level) - 1)) + PXSIZE(level);
+            continue;
+        }
+        // 大页只有一部分需要取消映射时，先拆分
+        if ((level > 0)
+            && (((_va & (PXSIZE(level) - 1)) != 0)
+                || (end - _va < PXSIZE(level)))) {
+            level = 0;
+            pte   = find(_pgd, _va, true, level);
+            assert(pte != nullptr);
+        }
+        if (flush_start == flush_end) {
+            flush_start = _va;
+        }
+        // 大页只有一项，否则清除同一页表中连续的页表项
+        size_t idx = PX(level, _va);
+        do {
+            global |= (*pte & VMM_PAGE_GLOBAL) != 0;
+            set_pte(_pgd, pte, 0x00);
+            pte++;
+            idx++;
+            _va += PXSIZE(level);
+        } while ((level == 0) && (idx < VMM_PAGES_PRE_PAGE_TABLE)
+                 && (_va < end));
+        flush_end  = _va;
+        // 页表中的页表项都被清除时释放页表
+        freed     += free_empty(_pgd, _va - PXSIZE(level), level);
+    }
+    // 统一刷新，释放了页表时刷新整个地址空间
+    if (freed != 0) {
+        flush(_pgd, 0, COMMON::PAGE_MASK, global);
+    }
+    else {
+        flush(_pgd, flush_start, flush_end, global);
+    }
+    return;
+}
+
+bool VMM::get_mmap(const pt_t _pgd, uintptr_t _va, const void* _pa,
+                   uint32_t* _flag) {
+    size_t level = 0;
+    pte_t* pte   = find(_pgd, _va, false, level);
+    bool   res   = false;
     // pte 不为空且有效，说明映射了
     if ((pte != nullptr) && ((*pte & VMM_PAGE_VALID) == 1)) {
         // 如果 _pa 不为空
         if (_pa != nullptr) {
             // 设置 _pa
             // 将页表项转换为物理地址
-            *(uintptr_t*)_pa = PTE2PA(*pte);
+            // 大页需要加上 _va 所在的页在大页中的偏移
+            uintptr_t off    = (_va & (PXSIZE(level) - 1)) & COMMON::PAGE_MASK;
+            *(uintptr_t*)_pa = PTE2PA(*pte) + off;
+        }
+        if (_flag != nullptr) {
+            *_flag = *pte & ((1 << VMM_PTE_PROP_BITS) - 1);
         }
         // 返回 true
         res = true;
@@ -176,3 +667,97 @@ bool VMM::get_mmap(const pt_t _pgd, uintptr_t _va, const void* _pa) {
     }
     return res;
 }
+
+pt_t VMM::clone(const pt_t _pgd) {
+    pt_t pgd = new_pgd();
+    if (pgd == nullptr) {
+        return nullptr;
+    }
+    // 顶级页表项指向相同的下级页表，之后对内核映射的修改在两边都可见
+    // 下级页表增加一个引用，由最后一个使用者释放
+    pt_t dst = pa2pt((uintptr_t)pgd);
+    pt_t src = pa2pt((uintptr_t)_pgd);
+    for (size_t i = 0; i < VMM_PAGES_PRE_PAGE_TABLE; i++) {
+        if ((src[i] & VMM_PAGE_VALID) == 0) {
+            continue;
+        }
+        if (is_leaf(src[i], VMM_PT_LEVEL - 1) == false) {
+            PMM::get_instance().get_page(PTE2PA(src[i]));
+        }
+        dst[i] = src[i];
+    }
+    return pgd;
+}
+
+bool VMM::cow_range(const pt_t _src, const pt_t _dst, uintptr_t _va,
+                    size_t _len) {
+    assert(((_va | _len) & ~COMMON::PAGE_MASK) == 0);
+    assert(_len != 0);
+    uintptr_t end = _va + _len;
+    // 区域所在的顶级页表项还与 _src 共享时，复制为私有的页表
+    // 区域不会与内核映射共享顶级页表项，复制的只有用户的映射
+    pt_t      src = pa2pt((uintptr_t)_src);
+    pt_t      dst = pa2pt((uintptr_t)_dst);
+    for (size_t i = PX(VMM_PT_LEVEL - 1, _va);
+         i <= PX(VMM_PT_LEVEL - 1, end - 1); i++) {
+        if (((src[i] & VMM_PAGE_VALID) == 0)
+            || (is_leaf(src[i], VMM_PT_LEVEL - 1) == true)
+            || (dst[i] != src[i])) {
+            continue;
+        }
+        uintptr_t pa = alloc_table();
+        if (pa == 0) {
+            return false;
+        }
+        dst[i] = PA2PTE(pa) | (src[i] & ((1 << VMM_PTE_PROP_BITS) - 1));
+        free_table(PTE2PA(src[i]));
+        if (clone_pt((pt_t)pa, (pt_t)PTE2PA(src[i]), VMM_PT_LEVEL - 2)
+            == false) {
+            return false;
+        }
+    }
+    // 需要刷新 TLB 的范围
+    uintptr_t flush_start = 0;
+    uintptr_t flush_end   = 0;
+    uintptr_t va          = _va;
+    while (va < end) {
+        size_t level = 0;
+        pte_t* src   = find(_src, va, false, level);
+        // 未映射的页表整体跳过，大页是内核或设备的映射，直接共享
+        if ((src == nullptr) || (level > 0)) {
+            uintptr_t next = (va & ~(PXSIZE(level) - 1)) + PXSIZE(level);
+            if (next < va) {
+                break;
+            }
+            va = next;
+            continue;
+        }
+        // 私有的页增加引用计数，可写时在两边都改为只读
+        uintptr_t pa   = PTE2PA(*src);
+        page_t*   page = PMM::get_instance().addr_to_page(pa);
+        if (((*src & VMM_PAGE_VALID) == VMM_PAGE_VALID) && (page != nullptr)
+            && (page->ref != 0)) {
+            PMM::get_instance().get_page(pa);
+            if ((*src & VMM_PAGE_WRITABLE) == VMM_PAGE_WRITABLE) {
+                pte_t* dst = find(_dst, va, false, level);
+                assert((dst != nullptr) && (level == 0));
+                *src &= ~(pte_t)VMM_PAGE_WRITABLE;
+                *dst  = *src;
+                if (flush_start == flush_end) {
+                    flush_start = va;
+                }
+                flush_end = va + COMMON::PAGE_SIZE;
+            }
+        }
+        va += COMMON::PAGE_SIZE;
+    }
+    // 源页目录中的页被改为只读，需要刷新其 TLB，新的页目录还没有使用过
+    flush(_src, flush_start, flush_end, false);
+    return true;
+}
+
+void VMM::free_pgd(pt_t _pgd) {
+    assert(_pgd != get_pgd());
+    free_pt(_pgd, VMM_PT_LEVEL - 1);
+    return;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file cpu.hpp
+ * @brief 宿主机上代替内核的 cpu.hpp
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#ifndef SIMPLEKERNEL_HOSTBENCH_CPU_HPP
+#define SIMPLEKERNEL_HOSTBENCH_CPU_HPP
+
+#include <cstdint>
+#include <ctime>
+
+namespace CPU {
+/// READ_TIME 每秒的计数
+static constexpr const uint64_t TIME_FREQ = 1000000000;
+
+/**
+ * @brief 读时间
+ * @return uint64_t         单调时间，单位为 ns
+ */
+inline static uint64_t READ_TIME(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * TIME_FREQ + ts.tv_nsec;
+}
+
+/**
+ * @brief 获取当前 core id
+ * @return size_t           宿主机上只使用 0
+ */
+inline static size_t GET_CORE_ID(void) {
+    return 0;
+}
+};     // namespace CPU
+
+#endif /* SIMPLEKERNEL_HOSTBENCH_CPU_HPP */
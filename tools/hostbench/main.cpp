@@ -0,0 +1,55 @@
+/**
+ * @file main.cpp
+ * @brief 在宿主机上运行页分配器基准测试
+ * @author Zone.N (Zone.Niuzh@hotmail.com)
+ * @version 1.0
+ * @date 2023-04-15
+ * @copyright MIT LICENSE
+ * https://github.com/Simple-XX/SimpleKernel
+ * @par change log:
+ * <table>
+ * <tr><th>Date<th>Author<th>Description
+ * <tr><td>2023-04-15<td>Zone.N<td>新建文件
+ * </table>
+ */
+
+#include "alloc_bench.h"
+#include "buddy.h"
+#include "cpu.hpp"
+#include "firstfit.h"
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+/// 分配器管理的地址，只用于计算，不会被访问
+static constexpr const uintptr_t BENCH_ADDR     = 0x40000000;
+/// 同时存在的最大分配数
+static constexpr const size_t    BENCH_LIVE_MAX = 512;
+
+int main(int _argc, char** _argv) {
+    // 默认与内核中的测试相同，128MB
+    size_t ops   = _argc > 1 ? strtoul(_argv[1], nullptr, 0) : 20000;
+    size_t pages = _argc > 2 ? strtoul(_argv[2], nullptr, 0) : 32768;
+    std::vector<ALLOC_BENCH::live_t> live(BENCH_LIVE_MAX);
+    {
+        std::vector<uint8_t> meta(BUDDY::get_meta_size(pages));
+        BUDDY       buddy("Buddy Allocator(bench)", BENCH_ADDR, pages,
+                          meta.data());
+        ALLOC_BENCH bench("buddy", (ALLOCATOR*)&buddy, live.data(),
+                          BENCH_LIVE_MAX, CPU::TIME_FREQ, 1);
+        bench.run(ops, ops / 4);
+        bench.free_all();
+        assert(((ALLOCATOR*)&buddy)->get_free_count() == pages);
+    }
+    {
+        std::vector<uint8_t> meta(FIRSTFIT::get_meta_size(pages));
+        FIRSTFIT    first_fit("First Fit Allocator(bench)", BENCH_ADDR, pages,
+                              meta.data());
+        ALLOC_BENCH bench("firstfit", (ALLOCATOR*)&first_fit, live.data(),
+                          BENCH_LIVE_MAX, CPU::TIME_FREQ, 1);
+        bench.run(ops, ops / 4);
+        bench.free_all();
+        assert(first_fit.get_free_count() == pages);
+    }
+    return 0;
+}